@@ -0,0 +1,354 @@
+/*
+ * mdmaker_bench, throughput of the MarkdownMaker stages on a synthetic corpus.
+ *
+ * mdmaker_bench <--files N> <--lines N> <--density F> <--nesting N> <--functions N> <--toc 0|1>
+ *               <--line-length N> <--pathological 0|1> <--seed N> <--repeat N> <--corpus DIR> <--generate DIR>
+ *               <--baseline FILE> <--tolerance F> <-o FILE>
+ *
+ * The corpus is written to a temporary directory (or to --corpus DIR, which is kept) and
+ * each stage is timed separately, the best of --repeat rounds is reported as JSON:
+ * * read, SourceReader opens the files and splits them to lines.
+ * * parseLine, SourceParser::parseLine over all the lines.
+ * * complete, SourceParser::complete renders the parsed content.
+ * * write, OutputWriter writes the rendered lines.
+ *
+ * Lines and bytes are the input of the stage, i.e. the output for write. Allocations
+ * are counted from the global operator new. With --baseline the MB/sec of each stage
+ * is compared to the given earlier result, and the exit code is 1 if any stage is
+ * slower than the tolerance (default 0.1) allows. --generate only writes the corpus.
+ * --pathological 1 declares the @functions with line long template types over several
+ * lines, after a line that mentions the function name, to time the declaration matching.
+ */
+
+#include "markdownmaker.h"
+#include "sourcereader.h"
+#include "outputwriter.h"
+#include "corpusgenerator.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iterator>
+#include <charconv>
+#include <cstring>
+
+#ifndef WINDOWS_OS
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+#ifndef MDMAKER_VERSION
+#define MDMAKER_VERSION "unknown"
+#endif
+
+static std::atomic<std::size_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if(auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+constexpr const char* Stages[] = {"read", "parseLine", "complete", "write"};
+
+/*
+ * Styles, starting from the built-in ones as in mdmaker, and the rendered lines of the sources
+ */
+class BenchContent : public ContentManager {
+public:
+    Sink sink(const std::string& sourceName) override {
+        auto& lines = m_lines[sourceName];
+        return [&lines](std::string_view line) {lines.emplace_back(line);};
+    }
+    void setStyle(const std::string& name, const std::string& style) override {m_styles.insert_or_assign(name, StyleTemplate(style));}
+    const StyleTemplate& style(std::string_view name) const override {
+        const auto it = m_styles.find(name);
+        return it == m_styles.end() ? defaultStyle() : it->second;
+    }
+    const std::map<std::string, std::vector<std::string>>& lines() const {return m_lines;}
+private:
+    std::map<std::string, std::vector<std::string>> m_lines; // elements are stable
+    StyleMap m_styles = defaultStyles();
+};
+
+struct Stage {
+    double seconds = 0;
+    std::size_t lines = 0;
+    std::size_t bytes = 0;
+    std::size_t allocations = 0;
+};
+
+struct Round {
+    Stage stages[std::size(Stages)];
+};
+
+class Timer {
+public:
+    Timer(Stage& stage) : m_stage(stage), m_allocations(allocations), m_start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+        m_stage.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        m_stage.allocations = allocations - m_allocations;
+    }
+private:
+    Stage& m_stage;
+    const std::size_t m_allocations;
+    const std::chrono::steady_clock::time_point m_start;
+};
+}
+
+static Round runRound(const std::vector<std::string>& files, const std::string& output) {
+    Round round;
+    auto& [reading, parsing, completing, writing] = round.stages;
+
+    std::vector<std::unique_ptr<SourceReader>> readers;
+    std::vector<std::vector<std::string_view>> lines(files.size());
+    {
+        const Timer timer(reading);
+        for(auto i = 0U; i < files.size(); ++i) {
+            readers.push_back(std::make_unique<SourceReader>(files[i]));
+            readers.back()->forEachLine([&lines, i](std::string_view line) {
+                lines[i].push_back(line);
+                return true;
+            });
+            reading.bytes += readers.back()->data().size();
+            reading.lines += lines[i].size();
+        }
+    }
+
+    BenchContent content;
+    std::vector<std::unique_ptr<SourceParser>> parsers;
+    for(const auto& f : files)
+        parsers.push_back(std::make_unique<SourceParser>(f, content));
+    {
+        const Timer timer(parsing);
+        for(auto i = 0U; i < files.size(); ++i) {
+            for(const auto& line : lines[i])
+                parsers[i]->parseLine(line);
+        }
+    }
+    parsing.lines = completing.lines = reading.lines;
+    parsing.bytes = completing.bytes = reading.bytes;
+
+    {
+        const Timer timer(completing);
+        for(auto& parser : parsers)
+            parser->complete();
+    }
+
+    for(const auto& [name, rendered] : content.lines()) {
+        writing.lines += rendered.size();
+        for(const auto& line : rendered)
+            writing.bytes += line.size() + 1;
+    }
+    {
+        const Timer timer(writing);
+        auto writer = OutputWriter::open(output);
+        if(!writer) {
+            std::cerr << "Cannot open:" << output << std::endl;
+            std::exit(-1);
+        }
+        for(const auto& [name, rendered] : content.lines()) {
+            for(const auto& line : rendered)
+                writer->writeLine(line);
+        }
+        writer->flush();
+    }
+    return round;
+}
+
+static std::string toJson(const CorpusOptions& options, const Round& best) {
+    const auto perSecond = [](double count, double seconds) {return seconds > 0 ? count / seconds : 0.0;};
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"version\": \"" << MDMAKER_VERSION << "\",\n";
+    out << "  \"corpus\": {\"files\": " << options.files << ", \"lines\": " << best.stages[0].lines
+        << ", \"bytes\": " << best.stages[0].bytes << ", \"density\": " << options.commentDensity
+        << ", \"nesting\": " << options.nesting << ", \"functions\": " << options.functions
+        << ", \"toc\": " << (options.toc ? "true" : "false") << ", \"line_length\": " << options.lineLength
+        << ", \"pathological\": " << (options.pathological ? "true" : "false")
+        << ", \"seed\": " << options.seed << "},\n";
+    out << "  \"stages\": {\n";
+    for(auto i = 0U; i < std::size(Stages); ++i) {
+        const auto& s = best.stages[i];
+        out << "    \"" << Stages[i] << "\": {\"seconds\": " << s.seconds
+            << ", \"lines_per_sec\": " << perSecond(static_cast<double>(s.lines), s.seconds)
+            << ", \"mb_per_sec\": " << perSecond(static_cast<double>(s.bytes) / (1024 * 1024), s.seconds)
+            << ", \"allocations_per_line\": " << (s.lines ? static_cast<double>(s.allocations) / s.lines : 0.0)
+            << "}" << (i + 1 < std::size(Stages) ? "," : "") << "\n";
+    }
+    out << "  }\n}\n";
+    return out.str();
+}
+
+/*
+ * Value of the key within the given stage of a result written by toJson
+ */
+static double jsonValue(const std::string& json, const std::string& stage, const std::string& key) {
+    const auto stages = json.find("\"stages\"");
+    const auto at = json.find("\"" + stage + "\"", stages == std::string::npos ? 0 : stages);
+    if(at == std::string::npos)
+        return 0;
+    const auto value = json.find("\"" + key + "\":", at);
+    if(value == std::string::npos || value > json.find('}', at))
+        return 0;
+    return std::strtod(json.c_str() + value + key.size() + 3, nullptr);
+}
+
+static bool compareBaseline(const std::string& baselineFile, const Round& best, double tolerance) {
+    std::ifstream file(baselineFile);
+    if(!file.is_open()) {
+        std::cerr << "Cannot open:" << baselineFile << std::endl;
+        return false;
+    }
+    const std::string baseline((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    bool ok = true;
+    for(auto i = 0U; i < std::size(Stages); ++i) {
+        const auto expected = jsonValue(baseline, Stages[i], "mb_per_sec");
+        const auto& s = best.stages[i];
+        const auto measured = s.seconds > 0 ? static_cast<double>(s.bytes) / (1024 * 1024) / s.seconds : 0.0;
+        if(expected > 0 && measured < expected * (1.0 - tolerance)) {
+            std::cerr << "Regression in " << Stages[i] << ": " << measured << " MB/sec, baseline "
+                      << expected << " MB/sec" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static std::vector<std::string> writeCorpus(const CorpusOptions& options, const std::filesystem::path& directory) {
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> files;
+    for(auto i = 0U; i < options.files; ++i) {
+        const auto name = (directory / ("header" + std::to_string(i) + ".h")).string();
+        std::ofstream(name, std::ios::binary) << generateSource(options, i);
+        files.push_back(name);
+    }
+    return files;
+}
+
+/* False if the value is not a number */
+template <typename T>
+static bool parseNumber(const char* value, T& number) {
+    const auto end = value + std::strlen(value);
+    const auto [last, ec] = std::from_chars(value, end, number);
+    return ec == std::errc() && last == end;
+}
+
+int main(int argc, char* argv[]) {
+    CorpusOptions options;
+    unsigned repeat = 3;
+    std::string corpus;
+    std::string baseline;
+    std::string output;
+    double tolerance = 0.1;
+    bool generateOnly = false;
+
+    for(auto i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+        const auto p = arg.substr(1);
+        const bool hasValue = i < argc - 1;
+        auto valid = true;
+        if(p == "-files" && hasValue) {
+            valid = parseNumber(argv[++i], options.files);
+        } else if(p == "-lines" && hasValue) {
+            valid = parseNumber(argv[++i], options.lines);
+        } else if(p == "-density" && hasValue) {
+            valid = parseNumber(argv[++i], options.commentDensity);
+        } else if(p == "-nesting" && hasValue) {
+            valid = parseNumber(argv[++i], options.nesting);
+        } else if(p == "-functions" && hasValue) {
+            valid = parseNumber(argv[++i], options.functions);
+        } else if(p == "-toc" && hasValue) {
+            options.toc = std::string(argv[++i]) != "0";
+        } else if(p == "-pathological" && hasValue) {
+            options.pathological = std::string(argv[++i]) != "0";
+        } else if(p == "-line-length" && hasValue) {
+            valid = parseNumber(argv[++i], options.lineLength);
+        } else if(p == "-seed" && hasValue) {
+            valid = parseNumber(argv[++i], options.seed);
+        } else if(p == "-repeat" && hasValue) {
+            valid = parseNumber(argv[++i], repeat);
+            repeat = std::max(1U, repeat);
+        } else if(p == "-corpus" && hasValue) {
+            corpus = argv[++i];
+        } else if(p == "-generate" && hasValue) {
+            corpus = argv[++i];
+            generateOnly = true;
+        } else if(p == "-baseline" && hasValue) {
+            baseline = argv[++i];
+        } else if(p == "-tolerance" && hasValue) {
+            valid = parseNumber(argv[++i], tolerance);
+        } else if(p == "o" && hasValue) {
+            output = argv[++i];
+        } else {
+            std::cerr << "Unknown argument:" << arg << std::endl;
+            return -1;
+        }
+        if(!valid) {
+            std::cerr << arg << " N, a number" << std::endl;
+            return -1;
+        }
+    }
+
+    const auto temporary = corpus.empty();
+    const auto directory = temporary ?
+                std::filesystem::temp_directory_path() / ("mdmaker_bench-" + std::to_string(getpid())) :
+                std::filesystem::path(corpus);
+    const auto files = writeCorpus(options, directory);
+    if(generateOnly)
+        return 0;
+
+    Round best;
+    for(auto r = 0U; r < repeat; ++r) {
+        const auto round = runRound(files, (directory / "bench.md").string());
+        for(auto i = 0U; i < std::size(Stages); ++i) {
+            if(r == 0 || round.stages[i].seconds < best.stages[i].seconds)
+                best.stages[i] = round.stages[i];
+        }
+    }
+
+    std::error_code ec;
+    if(temporary)
+        std::filesystem::remove_all(directory, ec);
+    else
+        std::filesystem::remove(directory / "bench.md", ec);
+
+    const auto json = toJson(options, best);
+    if(output.empty())
+        std::cout << json;
+    else
+        std::ofstream(output) << json;
+
+    if(!baseline.empty() && !compareBaseline(baseline, best, tolerance))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "corpusgenerator.h"
+#include <random>
+#include <vector>
+#include <algorithm>
+
+namespace {
+const std::vector<std::string> Words {
+    "the", "value", "is", "returned", "when", "a", "list", "of", "items", "and",
+    "parameters", "are", "given", "to", "function", "object", "with", "index", "if",
+    "<T>", "a&b", "it's", "\"quoted\"", "`code`", "**bold**", "@{x41}", "@{xE4}", "x->y"
+};
+
+class Generator {
+public:
+    Generator(const CorpusOptions& options, unsigned index) :
+        m_options(options), m_random(options.seed * 7919U + index), m_index(index) {}
+    std::string generate();
+private:
+    unsigned random(unsigned count) {return std::uniform_int_distribution<unsigned>(0, count - 1)(m_random);}
+    std::string text();
+    std::string templateType();
+    void line(const std::string& s) {m_text += s; m_text += '\n'; ++m_lines;}
+    void openScope(unsigned depth);
+    void docBlock();
+    void functionBlock();
+    void codeBlock();
+private:
+    const CorpusOptions& m_options;
+    std::mt19937 m_random;
+    const unsigned m_index;
+    std::string m_text;
+    unsigned m_lines = 0;
+    unsigned m_docLines = 0;
+    unsigned m_functions = 0;
+    unsigned m_scopes = 0;
+};
+}
+
+std::string Generator::text() {
+    std::string s;
+    while(s.size() < m_options.lineLength) {
+        if(!s.empty())
+            s += ' ';
+        s += Words[random(static_cast<unsigned>(Words.size()))];
+    }
+    return s;
+}
+
+/*
+ * Nested template type of about a line length
+ */
+std::string Generator::templateType() {
+    static const std::vector<std::string> Templates {"std::vector", "std::shared_ptr", "std::optional", "Container"};
+    std::string type = "int";
+    while(type.size() < m_options.lineLength) {
+        if(random(3) == 0)
+            type = "std::map<std::string, " + type + ">";
+        else
+            type = Templates[random(static_cast<unsigned>(Templates.size()))] + "<" + type + ">";
+    }
+    return type;
+}
+
+void Generator::openScope(unsigned depth) {
+    ++m_scopes;
+    if(depth % 2 == 0)
+        line(" * @namespace ns" + std::to_string(m_index) + "_" + std::to_string(m_scopes));
+    else
+        line(" * @class Class" + std::to_string(m_index) + "_" + std::to_string(m_scopes));
+    line(" * " + text());
+}
+
+void Generator::docBlock() {
+    const auto start = m_lines;
+    line("/**");
+    if(m_options.nesting > 0 && random(8) == 0) { // leave the innermost scope and enter a new one
+        line(" * @scopeend");
+        openScope(m_options.nesting - 1);
+    }
+    const auto count = 3 + random(8);
+    for(auto i = 0U; i < count; ++i)
+        line(" * " + text());
+    if(random(3) == 0) {
+        line(" * ```");
+        for(auto i = 0U; i < 3; ++i)
+            line(" *     auto v" + std::to_string(i) + " = list.at(" + std::to_string(i) + "); // " + text());
+        line(" * ```");
+    }
+    line(" */");
+    m_docLines += m_lines - start;
+}
+
+void Generator::functionBlock() {
+    const auto start = m_lines;
+    const auto name = "function" + std::to_string(m_index) + "_" + std::to_string(m_functions++);
+    line("/**");
+    line(" * @function " + name);
+    line(" * " + text());
+    line(" * @param value " + text());
+    line(" * @return " + text());
+    line(" */");
+    m_docLines += m_lines - start;
+    if(!m_options.pathological) {
+        line("std::vector<int> " + name + "(const std::string& value, int count = 0);");
+        return;
+    }
+    // the name is seen before the declaration, which is split to several lines
+    line("using " + name + "_type = " + templateType() + "; // " + name + " " + name);
+    line("template <typename T, typename U = " + templateType() + ">");
+    line("MDMAKER_EXPORT " + templateType() + " " + name + "(");
+    const auto count = 1 + random(4);
+    for(auto i = 0U; i < count; ++i)
+        line("    const " + templateType() + "& value" + std::to_string(i) + (i + 1 < count ? "," : ""));
+    line("    ) const noexcept;");
+}
+
+void Generator::codeBlock() {
+    const auto count = 4 + random(8);
+    for(auto i = 0U; i < count; ++i) {
+        std::string s = "    int member" + std::to_string(m_lines) + " = " + std::to_string(random(1000)) + "; //";
+        while(s.size() < m_options.lineLength)
+            s += " code";
+        line(s);
+    }
+}
+
+std::string Generator::generate() {
+    line("#pragma once");
+    line("/**");
+    if(m_options.toc)
+        line(" * @toc");
+    for(auto depth = 0U; depth < m_options.nesting; ++depth)
+        openScope(depth);
+    line(" */");
+    const auto total = std::max(m_options.lines, 1U);
+    while(m_lines < total) {
+        const auto progress = static_cast<double>(m_lines) / total;
+        if(m_functions < m_options.functions && m_functions < progress * m_options.functions + 1)
+            functionBlock();
+        else if(m_docLines < m_options.commentDensity * m_lines)
+            docBlock();
+        else
+            codeBlock();
+    }
+    line("/**");
+    for(auto depth = 0U; depth < m_options.nesting; ++depth)
+        line(" * @scopeend");
+    line(" */");
+    return m_text;
+}
+
+std::string generateSource(const CorpusOptions& options, unsigned index) {
+    return Generator(options, index).generate();
+}
@@ -0,0 +1,24 @@
+#ifndef CORPUSGENERATOR_H
+#define CORPUSGENERATOR_H
+
+#include <string>
+
+/*
+ * Synthetic C++ headers documented with MarkdownMaker annotations, used by
+ * mdmaker_bench. The same options and index always produce the same text.
+ */
+struct CorpusOptions {
+    unsigned files = 50;            // number of headers
+    unsigned lines = 4000;          // approximate lines per header
+    double commentDensity = 0.5;    // share of the lines inside documentation blocks
+    unsigned nesting = 2;           // depth of the @namespace / @class scopes
+    unsigned functions = 40;        // @function blocks per header
+    bool toc = true;                // each header has a @toc
+    unsigned lineLength = 72;       // approximate length of a text line
+    bool pathological = false;      // long template types, near misses and multi-line @function declarations
+    unsigned seed = 1;
+};
+
+std::string generateSource(const CorpusOptions& options, unsigned index);
+
+#endif // CORPUSGENERATOR_H
@@ -0,0 +1,186 @@
+#include "declarationmatcher.h"
+
+// bounds of the lookahead for the end of a parameter list
+constexpr unsigned MaxDeclarationLines = 16;
+constexpr std::size_t MaxDeclarationSize = 16 * 1024;
+
+namespace {
+/* Kind of a token before the function name */
+enum class Token {Start, Identifier, Template, Pointer, Scope, Comma, Other};
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool isLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool isIdentifierChar(char c) {
+    return isLetter(c) || (c >= '0' && c <= '9');
+}
+
+std::string_view trimmed(std::string_view text) {
+    while(!text.empty() && isSpace(text.front()))
+        text.remove_prefix(1);
+    while(!text.empty() && isSpace(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+
+/* Position after the string or character literal at pos, npos if it does not end */
+std::size_t skipLiteral(std::string_view text, std::size_t pos) {
+    const auto quote = text[pos];
+    for(auto i = pos + 1; i < text.size(); ++i) {
+        if(text[i] == '\\')
+            ++i;
+        else if(text[i] == quote)
+            return i + 1;
+    }
+    return std::string_view::npos;
+}
+
+/* Position after the bracket closing the one at pos, npos if it does not close */
+std::size_t skipGroup(std::string_view text, std::size_t pos, char open, char close) {
+    int depth = 0;
+    for(auto i = pos; i < text.size(); ++i) {
+        const auto c = text[i];
+        if(c == '"' || c == '\'') {
+            i = skipLiteral(text, i);
+            if(i == std::string_view::npos)
+                return i;
+            --i;
+        } else if(c == open) {
+            ++depth;
+        } else if(c == close && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+}
+
+void DeclarationMatcher::reset() {
+    m_declaration.clear();
+    m_lines = 0;
+    m_depth = 0;
+}
+
+/*
+ * The name has to be an identifier followed by '(' and preceded by the start of the line,
+ * a type, template arguments, '*', '&', '::' or ','; e.g. not by '=' or '.' as in a call.
+ * Brackets are skipped by looking ahead to their end, but an unbalanced '<' (that is
+ * an operator) is not looked ahead again, so each line is read at most twice.
+ */
+DeclarationMatcher::Status DeclarationMatcher::match(std::string_view line, std::string_view name) {
+    if(isIncomplete()) {
+        const auto text = trimmed(line);
+        if(!text.empty() && m_declaration.back() != '(' && text.front() != ')')
+            m_declaration += ' ';
+        const auto start = m_declaration.size();
+        m_declaration.append(text);
+        ++m_lines;
+        return scanParameters(start);
+    }
+    auto previous = Token::Start;
+    auto last = Token::Start;
+    std::string_view identifier;
+    bool templates = true;
+    for(std::size_t i = 0; i < line.size();) {
+        const auto c = line[i];
+        if(isSpace(c)) {
+            ++i;
+            continue;
+        }
+        if(isLetter(c)) {
+            auto end = i + 1;
+            while(end < line.size() && isIdentifierChar(line[end]))
+                ++end;
+            identifier = line.substr(i, end - i);
+            previous = last;
+            last = Token::Identifier;
+            i = end;
+            continue;
+        }
+        auto end = std::string_view::npos;
+        switch(c) {
+        case '(':
+            if(last == Token::Identifier && previous != Token::Other && identifier == name) {
+                const auto text = trimmed(line);
+                m_declaration.assign(text);
+                m_lines = 1;
+                m_depth = 0;
+                return scanParameters(static_cast<std::size_t>(&line[i] - text.data()));
+            }
+            end = skipGroup(line, i, '(', ')'); // e.g. a macro or an attribute
+            if(end == std::string_view::npos)
+                return Status::NotFound;
+            last = Token::Other;
+            break;
+        case '<':
+            if(templates)
+                end = skipGroup(line, i, '<', '>');
+            templates = end != std::string_view::npos;
+            last = templates ? Token::Template : Token::Other;
+            break;
+        case '"':
+        case '\'':
+            end = skipLiteral(line, i);
+            if(end == std::string_view::npos)
+                return Status::NotFound;
+            last = Token::Other;
+            break;
+        case ':':
+            last = i + 1 < line.size() && line[i + 1] == ':' ? Token::Scope : Token::Other;
+            end = i + (last == Token::Scope ? 2 : 1);
+            break;
+        case '*':
+        case '&':
+            last = Token::Pointer;
+            break;
+        case ',':
+            last = Token::Comma;
+            break;
+        default:
+            last = Token::Other;
+            break;
+        }
+        i = end == std::string_view::npos ? i + 1 : end;
+    }
+    return Status::NotFound;
+}
+
+/*
+ * Continues the parameter list from the given position of the declaration,
+ * the qualifier is a word after the list, separated by at most a single space
+ */
+DeclarationMatcher::Status DeclarationMatcher::scanParameters(std::size_t pos) {
+    const std::string_view text(m_declaration);
+    for(auto i = pos; i < text.size(); ++i) {
+        const auto c = text[i];
+        if(c == '"' || c == '\'') {
+            const auto end = skipLiteral(text, i);
+            if(end == std::string_view::npos)
+                break;
+            i = end - 1;
+        } else if(c == '(') {
+            ++m_depth;
+        } else if(c == ')' && --m_depth == 0) {
+            auto end = i + 1;
+            const auto qualifier = end < text.size() && isSpace(text[end]) ? end + 1 : end;
+            auto word = qualifier;
+            while(word < text.size() && isLetter(text[word]))
+                ++word;
+            if(word > qualifier)
+                end = word;
+            m_declaration.resize(end);
+            m_lines = 0;
+            return Status::Found;
+        }
+    }
+    if(m_lines >= MaxDeclarationLines || m_declaration.size() > MaxDeclarationSize) {
+        reset();
+        return Status::TooLong;
+    }
+    return Status::Incomplete;
+}
@@ -0,0 +1,37 @@
+#ifndef DECLARATIONMATCHER_H
+#define DECLARATIONMATCHER_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Finds the declaration of a @function in the source lines after its documentation,
+ * in a single pass over each line. The declaration is the text from the start of the
+ * line naming the function to the end of its parameter list, which may continue on the
+ * following lines, and a qualifier right after it (e.g. const). Template arguments,
+ * macros and attributes before the name are skipped.
+ */
+class DeclarationMatcher {
+public:
+    enum class Status {
+        NotFound,   // the line does not declare the function
+        Incomplete, // the parameter list continues on the next line
+        Found,
+        TooLong     // no end of the parameter list within the lookahead limits
+    };
+public:
+    /* The next line, that is given without its line terminator */
+    Status match(std::string_view line, std::string_view name);
+    /* The declaration when Found, lines of a parameter list are joined with a space */
+    const std::string& declaration() const {return m_declaration;}
+    bool isIncomplete() const {return m_lines > 0;}
+    void reset();
+private:
+    Status scanParameters(std::size_t pos);
+private:
+    std::string m_declaration;
+    unsigned m_lines = 0;   // lines of an incomplete declaration
+    int m_depth = 0;        // open parentheses of an incomplete declaration
+};
+
+#endif // DECLARATIONMATCHER_H
@@ -0,0 +1,213 @@
+#include "filediscovery.h"
+#include "sourcereader.h"
+#include "textsearch.h"
+#include "parallelfor.h"
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <cctype>
+#include <numeric>
+
+constexpr std::string_view DefaultIncludes[] = {
+    "*.h", "*.hh", "*.hpp", "*.hxx", "*.c", "*.cc", "*.cpp", "*.cxx", "*.md"
+};
+
+namespace {
+struct Candidate {
+    std::size_t argument;
+    std::string name;
+    std::string path;
+    bool markup;
+    bool check;     // dropped if it has no documentation
+};
+
+struct Directory {
+    std::size_t argument;
+    std::string name;
+    std::filesystem::path path;
+    std::string relative;   // path from the argument with '/' separators
+};
+}
+
+static bool isMarkup(const std::string& name) {
+    const auto dot = name.find_last_of('.');
+    const auto slash = name.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return false;
+    const auto extension = name.substr(dot + 1);
+    return extension.size() == 2 && std::tolower(extension[0]) == 'm' && std::tolower(extension[1]) == 'd';
+}
+
+void FileDiscovery::include(const std::string& glob) {
+    m_includes.push_back(glob);
+}
+
+void FileDiscovery::exclude(const std::string& glob) {
+    m_excludes.push_back(glob);
+}
+
+void FileDiscovery::setDirectory(const std::string& directory) {
+    m_directory = directory;
+}
+
+std::string FileDiscovery::resolved(const std::string& path) const {
+    if(m_directory.empty() || std::filesystem::path(path).is_absolute())
+        return path;
+    return (std::filesystem::path(m_directory) / path).string();
+}
+
+bool FileDiscovery::add(const std::string& argument) {
+    if(argument.size() < 2 || argument.front() != '@') {
+        m_arguments.push_back({argument, resolved(argument), false});
+        return true;
+    }
+    const auto listFile = argument.substr(1);
+    const SourceReader file(resolved(listFile));
+    if(!file.isOpen())
+        return false;
+    m_listFiles.push_back(listFile);
+    file.forEachLine([this](std::string_view line) {
+        while(!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+            line.remove_suffix(1);
+        while(!line.empty() && std::isspace(static_cast<unsigned char>(line.front())))
+            line.remove_prefix(1);
+        if(!line.empty() && line.front() != '#')
+            m_arguments.push_back({std::string(line), resolved(std::string(line)), true});
+        return true;
+    });
+    return true;
+}
+
+bool FileDiscovery::matches(std::string_view glob, std::string_view path) {
+    if(glob.find('/') == std::string_view::npos) {
+        const auto slash = path.find_last_of('/');
+        if(slash != std::string_view::npos)
+            path.remove_prefix(slash + 1);
+    }
+    while(!glob.empty()) {
+        if(glob.front() == '*') {
+            const auto any = glob.size() > 1 && glob[1] == '*';
+            glob.remove_prefix(any ? 2 : 1);
+            if(any && !glob.empty() && glob.front() == '/' && matches(glob.substr(1), path)) // "**/" matches no directory too
+                return true;
+            for(std::size_t i = 0; i <= path.size(); ++i) {
+                if(matches(glob, path.substr(i)))
+                    return true;
+                if(!any && i < path.size() && path[i] == '/')
+                    return false;
+            }
+            return false;
+        }
+        if(path.empty() || (glob.front() == '?' ? path.front() == '/' : glob.front() != path.front()))
+            return false;
+        glob.remove_prefix(1);
+        path.remove_prefix(1);
+    }
+    return path.empty();
+}
+
+bool FileDiscovery::isIncluded(const std::string& path) const {
+    if(m_includes.empty())
+        return std::any_of(std::begin(DefaultIncludes), std::end(DefaultIncludes), [&path](auto glob) {return matches(glob, path);});
+    return std::any_of(m_includes.begin(), m_includes.end(), [&path](const auto& glob) {return matches(glob, path);});
+}
+
+bool FileDiscovery::isExcluded(const std::string& path) const {
+    return std::any_of(m_excludes.begin(), m_excludes.end(), [&path](const auto& glob) {return matches(glob, path);});
+}
+
+/*
+ * Workers take directories from a shared queue and add the subdirectories back to it,
+ * the walk ends when the queue is empty and no worker is reading a directory.
+ */
+std::vector<FileDiscovery::Input> FileDiscovery::discover(unsigned jobs, std::vector<std::string>* read) const {
+    std::vector<Candidate> candidates;
+    std::deque<Directory> queue;
+    std::vector<std::string> walked;
+    for(auto i = 0U; i < m_arguments.size(); ++i) {
+        const auto& argument = m_arguments[i];
+        std::error_code ec;
+        if(std::filesystem::is_directory(argument.path, ec))
+            queue.push_back({i, argument.name, argument.path, {}});
+        else
+            candidates.push_back({i, argument.name, argument.path, isMarkup(argument.name), argument.listed});
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned reading = 0;
+    const auto walk = [this, &candidates, &queue, &walked, &mutex, &changed, &reading]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            changed.wait(lock, [&queue, &reading]() {return !queue.empty() || reading == 0;});
+            if(queue.empty())
+                return;
+            const auto directory = std::move(queue.front());
+            queue.pop_front();
+            ++reading;
+            lock.unlock();
+            std::vector<Directory> subdirectories;
+            std::vector<Candidate> files;
+            std::error_code ec;
+            std::filesystem::directory_iterator it(directory.path, std::filesystem::directory_options::skip_permission_denied, ec);
+            for(; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+                const auto name = it->path().filename().string();
+                const auto relative = directory.relative.empty() ? name : directory.relative + '/' + name;
+                const auto given = m_directory.empty() ? it->path().string() : (std::filesystem::path(directory.name) / name).string();
+                if(isExcluded(relative))
+                    continue;
+                std::error_code statusEc;
+                // symbolic links to directories are not followed, they could make a cycle
+                if(it->symlink_status(statusEc).type() == std::filesystem::file_type::directory)
+                    subdirectories.push_back({directory.argument, given, it->path(), relative});
+                else if(it->is_regular_file(statusEc) && isIncluded(relative))
+                    files.push_back({directory.argument, given, it->path().string(), isMarkup(name), true});
+            }
+            if(ec)
+                std::cerr << "Cannot read directory:" << directory.name << std::endl;
+            lock.lock();
+            --reading;
+            walked.push_back(directory.name);
+            queue.insert(queue.end(), subdirectories.begin(), subdirectories.end());
+            candidates.insert(candidates.end(), files.begin(), files.end());
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> walkers;
+    for(auto i = 0U; !queue.empty() && i < std::max(1U, jobs); ++i)
+        walkers.emplace_back(walk);
+    std::for_each(walkers.begin(), walkers.end(), [](auto& t){t.join();});
+
+    // a source can have documentation only after "/**"
+    std::vector<char> keep(candidates.size(), 1);
+    parallelFor(candidates.size(), std::max(1U, jobs), [&candidates, &keep](std::size_t i) {
+        if(!candidates[i].check || candidates[i].markup)
+            return;
+        const SourceReader file(candidates[i].path);
+        if(!file.isOpen())
+            std::cerr << "Cannot open:" << candidates[i].name << std::endl;
+        keep[i] = file.isOpen() && findText(file.data(), "/**", 0) != std::string_view::npos;
+    });
+
+    std::vector<std::size_t> order(candidates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&candidates](auto a, auto b) {
+        return candidates[a].argument != candidates[b].argument ? candidates[a].argument < candidates[b].argument
+                                                                : candidates[a].name < candidates[b].name;
+    });
+    if(read) {
+        *read = m_listFiles;
+        std::sort(walked.begin(), walked.end());
+        read->insert(read->end(), walked.begin(), walked.end());
+        for(const auto i : order)
+            read->push_back(candidates[i].name);
+    }
+    std::vector<Input> inputs;
+    for(const auto i : order) {
+        if(keep[i])
+            inputs.push_back({candidates[i].name, candidates[i].markup, candidates[i].path});
+    }
+    return inputs;
+}
@@ -0,0 +1,58 @@
+#ifndef FILEDISCOVERY_H
+#define FILEDISCOVERY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Input files of a generation. An argument is a file, a directory that is walked
+ * recursively or a response file (@listfile) listing files and directories, one per line.
+ * Directories are walked in parallel and their files are sorted by path, so the inputs
+ * are the same on every run. Except for the files given as arguments, source files
+ * without any documentation comment are dropped as they have nothing to generate.
+ */
+class FileDiscovery {
+public:
+    struct Input {
+        std::string name;   // as given, relative to the directory
+        bool markup;        // a markdown file (*.md) that is added as-is
+        std::string path;   // to open, the name taken from the directory
+    };
+public:
+    /* Only the files in directories matching any include glob, by default the sources and markdown files */
+    void include(const std::string& glob);
+    /* Files and directories matching any exclude glob are skipped in directories */
+    void exclude(const std::string& glob);
+    /* Relative paths are opened from the directory instead of the working directory, the names are kept as given */
+    void setDirectory(const std::string& directory);
+    /* False if a response file cannot be read */
+    bool add(const std::string& argument);
+    /*
+     * The inputs in the order of the arguments. If given, read gets the names of the response files,
+     * the walked directories and all the files looked into, also those dropped.
+     */
+    std::vector<Input> discover(unsigned jobs, std::vector<std::string>* read = nullptr) const;
+    /*
+     * '*' matches anything but '/', '**' anything and '?' any character but '/'.
+     * A glob without '/' matches the file name, otherwise the path.
+     */
+    static bool matches(std::string_view glob, std::string_view path);
+private:
+    struct Argument {
+        std::string name;
+        std::string path;
+        bool listed;    // from a response file
+    };
+    bool isIncluded(const std::string& path) const;
+    bool isExcluded(const std::string& path) const;
+    std::string resolved(const std::string& path) const;
+private:
+    std::string m_directory;
+    std::vector<Argument> m_arguments;
+    std::vector<std::string> m_listFiles;
+    std::vector<std::string> m_includes;
+    std::vector<std::string> m_excludes;
+};
+
+#endif // FILEDISCOVERY_H
@@ -0,0 +1,88 @@
+#include "filewatcher.h"
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+constexpr int SettleTimeMs = 5; // coalesce the events of a single save
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher(const std::vector<std::string>& files) {
+    m_fd = ::inotify_init1(IN_CLOEXEC);
+    if(m_fd < 0)
+        return;
+    std::unordered_map<std::string, int> watches;
+    for(auto i = 0U; i < files.size(); ++i) {
+        std::error_code ec;
+        const auto path = std::filesystem::weakly_canonical(files[i], ec);
+        if(ec)
+            continue;
+        const auto directory = path.parent_path().string();
+        if(watches.find(directory) == watches.end()) {
+            const auto wd = ::inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM);
+            if(wd < 0) {
+                std::cerr << "Cannot watch:" << directory << std::endl;
+                continue;
+            }
+            watches[directory] = wd;
+            m_directories[wd] = directory;
+        }
+        m_files[path.string()].push_back(i);
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if(m_fd >= 0)
+        ::close(m_fd);
+}
+
+std::vector<std::size_t> FileWatcher::wait() {
+    std::vector<std::size_t> changed;
+    alignas(inotify_event) char buffer[64 * 1024];
+    auto timeout = -1;
+    for(;;) {
+        pollfd p{m_fd, POLLIN, 0};
+        const auto ready = ::poll(&p, 1, timeout);
+        if(ready < 0 && errno == EINTR)
+            continue;
+        if(ready <= 0)
+            break;
+        const auto len = ::read(m_fd, buffer, sizeof(buffer));
+        if(len <= 0)
+            break;
+        for(auto pos = 0L; pos < len;) {
+            const auto event = reinterpret_cast<const inotify_event*>(buffer + pos);
+            pos += static_cast<long>(sizeof(inotify_event) + event->len);
+            const auto dir = m_directories.find(event->wd);
+            if(dir == m_directories.end() || event->len == 0)
+                continue;
+            const auto it = m_files.find((std::filesystem::path(dir->second) / event->name).string());
+            if(it != m_files.end())
+                changed.insert(changed.end(), it->second.begin(), it->second.end());
+        }
+        if(!changed.empty())
+            timeout = SettleTimeMs;
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return changed;
+}
+
+#else
+
+FileWatcher::FileWatcher(const std::vector<std::string>&) {}
+
+FileWatcher::~FileWatcher() {}
+
+std::vector<std::size_t> FileWatcher::wait() {
+    return {};
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/*
+ * Notifies changes of a set of files. The directories of the files are watched,
+ * so files replaced by editors (written to a new file and renamed) are noticed too,
+ * as well as files deleted or moved away.
+ * Implemented using inotify, elsewhere isValid returns false.
+ */
+class FileWatcher {
+public:
+    explicit FileWatcher(const std::vector<std::string>& files);
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+    bool isValid() const {return m_fd >= 0;}
+    /* Blocks until some of the files have changed, returns their indices in ascending order */
+    std::vector<std::size_t> wait();
+private:
+    int m_fd = -1;
+    std::unordered_map<int, std::string> m_directories;
+    std::unordered_map<std::string, std::vector<std::size_t>> m_files;
+};
+
+#endif // FILEWATCHER_H
@@ -0,0 +1,229 @@
+#include "fragmentcache.h"
+#include "sourcereader.h"
+#include "outputwriter.h"
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <charconv>
+#include <algorithm>
+
+#ifndef MDMAKER_VERSION
+#define MDMAKER_VERSION "unknown"
+#endif
+
+constexpr char CacheFormat[] = "mdmaker-fragment-6";
+// in-memory entries are dropped all together when there are more
+constexpr std::size_t MaxMemoryEntries = 16384;
+// a directory larger than this is trimmed to TrimmedDirectorySize, the least recently used entries first
+constexpr std::uintmax_t MaxDirectorySize = 256 * 1024 * 1024;
+constexpr std::uintmax_t TrimmedDirectorySize = MaxDirectorySize / 4 * 3;
+
+namespace {
+/*
+ * 64-bit FNV-1a and a second, multiplicative 64-bit hash of the same data, as a key is
+ * taken for the content it names the two have to collide together
+ */
+class Hash {
+public:
+    Hash& add(std::string_view data) {
+        for(const auto c : data) {
+            m_hash ^= static_cast<unsigned char>(c);
+            m_hash *= 0x100000001b3ULL;
+            m_check = (m_check + static_cast<unsigned char>(c)) * 0x9e3779b97f4a7c15ULL;
+            m_check ^= m_check >> 29;
+        }
+        return *this;
+    }
+    Hash& add(std::size_t value) {
+        return add(std::to_string(value) + ':');
+    }
+    std::string hex() const {
+        std::ostringstream out;
+        out << std::hex << std::setfill('0') << std::setw(16) << m_hash << std::setw(16) << m_check;
+        return out.str();
+    }
+private:
+    unsigned long long m_hash = 0xcbf29ce484222325ULL;
+    unsigned long long m_check = 0x2545f4914f6cdd1dULL;
+};
+}
+
+FragmentCache::FragmentCache(const std::string& directory) : m_directory(directory) {
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    if(ec)
+        std::cerr << "Cannot create cache directory:" << m_directory << std::endl;
+}
+
+FragmentCache::FragmentCache() {
+}
+
+FragmentCache::~FragmentCache() {
+    if(!m_directory.empty() && m_stored)
+        trim();
+}
+
+std::string FragmentCache::contentKey(std::string_view sourceName, std::string_view content) {
+    return sourceKey(sourceName, contentHash(content));
+}
+
+std::string FragmentCache::contentHash(std::string_view content) {
+    Hash hash;
+    hash.add(content.size()).add(content);
+    return hash.hex();
+}
+
+std::string FragmentCache::sourceKey(std::string_view sourceName, std::string_view contentHash) {
+    Hash hash;
+    hash.add(CacheFormat).add(MDMAKER_VERSION).add(sourceName.size()).add(sourceName).add(contentHash);
+    return hash.hex();
+}
+
+std::string FragmentCache::stylesKey(const std::vector<std::pair<std::string, std::string>>& styles) {
+    Hash hash;
+    for(const auto& [name, style] : styles)
+        hash.add(name.size()).add(name).add(style.size()).add(style);
+    return hash.hex();
+}
+
+/*
+ * Source entry is the messages, the count of the anchors, the anchors and then the name
+ * and the style of each style change
+ */
+std::optional<FragmentCache::Source> FragmentCache::loadSource(const std::string& contentKey) const {
+    const auto strings = read(contentKey + ".source");
+    if(!strings || strings->size() < 2)
+        return std::nullopt;
+    const auto& count = (*strings)[1];
+    std::size_t anchors = 0;
+    const auto [end, ec] = std::from_chars(count.data(), count.data() + count.size(), anchors);
+    if(ec != std::errc() || end != count.data() + count.size() || strings->size() - 2 < anchors || (strings->size() - anchors) % 2 != 0)
+        return std::nullopt;
+    Source source;
+    source.messages = strings->front();
+    source.anchors.assign(strings->begin() + 2, strings->begin() + 2 + static_cast<std::ptrdiff_t>(anchors));
+    for(auto i = anchors + 2; i < strings->size(); i += 2)
+        source.styles.push_back({(*strings)[i], (*strings)[i + 1]});
+    return source;
+}
+
+std::optional<std::vector<std::string>> FragmentCache::loadFragment(const std::string& contentKey, const std::string& stylesKey) const {
+    return read(contentKey + '-' + stylesKey + ".md");
+}
+
+void FragmentCache::store(const std::string& contentKey, const std::string& stylesKey,
+                          const Source& source, const std::vector<std::string>& lines) {
+    // fragment first, a source entry without any fragment would be a certain miss
+    if(!write(contentKey + '-' + stylesKey + ".md", lines))
+        return;
+    std::vector<std::string> strings{source.messages, std::to_string(source.anchors.size())};
+    strings.insert(strings.end(), source.anchors.begin(), source.anchors.end());
+    for(const auto& [name, style] : source.styles) {
+        strings.push_back(name);
+        strings.push_back(style);
+    }
+    write(contentKey + ".source", strings);
+}
+
+/*
+ * Entry is the format tag, its whole key, the count of strings and then each string as its length and bytes
+ */
+bool FragmentCache::write(const std::string& name, const std::vector<std::string>& strings) {
+    if(m_directory.empty()) {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_memory.size() >= MaxMemoryEntries)
+            m_memory.clear();
+        m_memory.insert_or_assign(name, strings);
+        return true;
+    }
+    std::ostringstream entry;
+    entry << CacheFormat << '\n' << name << '\n' << strings.size() << '\n';
+    for(const auto& s : strings)
+        entry << s.size() << '\n' << s << '\n';
+    if(!atomicReplace((std::filesystem::path(m_directory) / name).string(), entry.str()))
+        return false;
+    m_stored = true;
+    return true;
+}
+
+std::optional<std::vector<std::string>> FragmentCache::read(const std::string& name) const {
+    if(m_directory.empty()) {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_memory.find(name);
+        if(it == m_memory.end())
+            return std::nullopt;
+        return it->second;
+    }
+    const auto path = (std::filesystem::path(m_directory) / name).string();
+    const SourceReader file(path);
+    if(!file.isOpen())
+        return std::nullopt;
+    const auto data = file.data();
+    std::size_t pos = 0;
+    const auto number = [&data, &pos]() -> std::optional<std::size_t> {
+        const auto end = data.find('\n', pos);
+        if(end == std::string_view::npos || end == pos)
+            return std::nullopt;
+        // a corrupt number, e.g. of more digits than fit, is a miss
+        std::size_t value = 0;
+        const auto [last, ec] = std::from_chars(data.data() + pos, data.data() + end, value);
+        if(ec != std::errc() || last != data.data() + end)
+            return std::nullopt;
+        pos = end + 1;
+        return value;
+    };
+    // the entry tells the whole key it was written for
+    const auto header = std::string(CacheFormat) + '\n' + name + '\n';
+    if(data.substr(0, header.size()) != header)
+        return std::nullopt;
+    pos = header.size();
+    const auto count = number();
+    if(!count)
+        return std::nullopt;
+    std::vector<std::string> strings;
+    for(auto i = 0U; i < *count; ++i) {
+        const auto size = number();
+        if(!size || *size >= data.size() - pos || data[pos + *size] != '\n')
+            return std::nullopt;
+        strings.emplace_back(data.substr(pos, *size));
+        pos += *size + 1;
+    }
+    // the modification time tells when the entry was used last
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return strings;
+}
+
+/*
+ * Removes the least recently used entries of a directory grown larger than MaxDirectorySize.
+ * An entry removed while another process reads it is a miss to that process.
+ */
+void FragmentCache::trim() const {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        std::uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t size = 0;
+    std::error_code ec;
+    for(auto it = std::filesystem::directory_iterator(m_directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::error_code entryError;
+        if(!it->is_regular_file(entryError))
+            continue;
+        const auto fileSize = it->file_size(entryError);
+        const auto time = it->last_write_time(entryError);
+        if(entryError)
+            continue;
+        entries.push_back({it->path(), time, fileSize});
+        size += fileSize;
+    }
+    if(size <= MaxDirectorySize)
+        return;
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {return a.time < b.time;});
+    for(auto it = entries.begin(); it != entries.end() && size > TrimmedDirectorySize; ++it) {
+        if(std::filesystem::remove(it->path, ec))
+            size -= it->size;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef FRAGMENTCACHE_H
+#define FRAGMENTCACHE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <utility>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * Directory of rendered source file fragments. A source is first looked up by its
+ * content key, which tells the style changes the file makes and the messages it gives,
+ * and then by its content and the effective style table, which gives the rendered lines.
+ * The key covers the name of the source too, as its error lines tell it. Entries are written
+ * to a temporary file and renamed in place, so several processes can share a directory.
+ * A directory grown over 256 MB is trimmed, the least recently used entries first.
+ */
+class FragmentCache {
+public:
+    using StyleChanges = std::vector<std::pair<std::string, std::string>>;
+    /* What a source does besides its lines: the styles it sets, its messages to stderr and the slugs of its anchors */
+    struct Source {
+        StyleChanges styles;
+        std::string messages;
+        std::vector<std::string> anchors;
+    };
+    explicit FragmentCache(const std::string& directory);
+    /* Entries are kept in memory, e.g. for the jobs of a server */
+    FragmentCache();
+    /* Trims the directory if any entry was written to it */
+    ~FragmentCache();
+    FragmentCache(const FragmentCache&) = delete;
+    FragmentCache& operator=(const FragmentCache&) = delete;
+    static std::string contentKey(std::string_view sourceName, std::string_view content);
+    /* Hash of the content alone, the content key is made of it and the name */
+    static std::string contentHash(std::string_view content);
+    static std::string sourceKey(std::string_view sourceName, std::string_view contentHash);
+    static std::string stylesKey(const std::vector<std::pair<std::string, std::string>>& styles);
+    std::optional<Source> loadSource(const std::string& contentKey) const;
+    std::optional<std::vector<std::string>> loadFragment(const std::string& contentKey, const std::string& stylesKey) const;
+    void store(const std::string& contentKey, const std::string& stylesKey,
+               const Source& source, const std::vector<std::string>& lines);
+    void hit() {++m_hits;}
+    void miss() {++m_misses;}
+    unsigned hits() const {return m_hits;}
+    unsigned misses() const {return m_misses;}
+private:
+    bool write(const std::string& name, const std::vector<std::string>& strings);
+    std::optional<std::vector<std::string>> read(const std::string& name) const;
+    void trim() const;
+private:
+    const std::string m_directory;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::vector<std::string>> m_memory; // when there is no directory
+    std::atomic<unsigned> m_hits{0};
+    std::atomic<unsigned> m_misses{0};
+    std::atomic<bool> m_stored{false};
+};
+
+#endif // FRAGMENTCACHE_H
@@ -0,0 +1,411 @@
+/*
+ * mdmaker_fuzz, differential checks of the SourceParser on generated and mutated sources.
+ *
+ * mdmaker_fuzz <--runs N> <--seed N> <--save FILE> <FILES>
+ *
+ * Each input is rendered by an optimised path and by its reference and the first diverging
+ * line is reported:
+ * * regex, SourceParser::parse against the regex based parser of MarkdownMaker 1.0 (test/referenceparser.h).
+ * * parse, SourceParser::parse, that skips the code between the documentation blocks,
+ *   against SourceParser::parseLine of every line, both buffered and streaming.
+ * * parts, the source split to parts of random size that are parsed separately and appended,
+ *   against SourceParser::parse of the whole source.
+ * * stream, MarkdownStream written in pieces of random size against the whole source at once.
+ * * declaration, DeclarationMatcher against the regex that found the declaration of a @function before,
+ *   on the lines that start with the declaration and have no literals nor other parentheses than its parameter list.
+ * * style, StyleTemplate::render against std::regex_replace of %1, as the styles were applied before.
+ *
+ * FILES are checked as they are and then used, as well as the synthetic corpus, as seeds of
+ * the --runs (default 1000) mutated inputs. The input of a divergence is written to --save FILE
+ * (default mdmaker_fuzz_failure.h), that is checked again with mdmaker_fuzz --runs 0 FILE.
+ * The exit code is 1 if any check diverges. ctest runs 300 inputs, together with the golden
+ * outputs of test/golden (README.md is the golden output of markdownmaker.h), and checks the
+ * saved inputs of test/fuzz.
+ *
+ * Built with MDMAKER_LIBFUZZER, the same checks are a libFuzzer target instead (cmake -DMDMAKER_LIBFUZZER=ON,
+ * requires clang), where a divergence aborts.
+ */
+
+#include "markdownmaker.h"
+#include "markdownstream.h"
+#include "corpusgenerator.h"
+#include "declarationmatcher.h"
+#include "test/referenceparser.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <unordered_set>
+#include <regex>
+#include <cstdlib>
+#include <cstdint>
+
+namespace {
+
+/*
+ * Default styles and the rendered lines of a source
+ */
+class Collector : public ContentManager {
+public:
+    Sink sink(const std::string&) override {
+        return [this](std::string_view line) {m_lines.emplace_back(line);};
+    }
+    void setStyle(const std::string& name, const std::string& style) override {m_styles.insert_or_assign(name, StyleTemplate(style));}
+    const StyleTemplate& style(std::string_view name) const override {
+        const auto it = m_styles.find(name);
+        return it == m_styles.end() ? defaultStyle() : it->second;
+    }
+    const std::vector<std::string>& lines() const {return m_lines;}
+private:
+    std::vector<std::string> m_lines;
+    StyleMap m_styles = defaultStyles();
+};
+
+struct Divergence {
+    std::string check;
+    std::size_t line;   // from 1
+    std::string expected;
+    std::string actual;
+};
+
+/* Parse errors are rendered to the output too, they are not printed while checking */
+class Quiet {
+public:
+    Quiet() : m_buffer(std::cerr.rdbuf(nullptr)) {}
+    ~Quiet() {
+        std::cerr.rdbuf(m_buffer);
+        std::cerr.clear();
+    }
+private:
+    std::streambuf* const m_buffer;
+};
+
+std::vector<std::string> splitLines(std::string_view text) {
+    std::vector<std::string> lines;
+    std::size_t pos = 0;
+    while(pos < text.size()) {
+        const auto end = text.find('\n', pos);
+        const auto last = end == std::string_view::npos ? text.size() : end;
+        lines.emplace_back(text.substr(pos, last - pos));
+        pos = last + 1;
+    }
+    return lines;
+}
+
+std::optional<Divergence> compare(const std::string& check, const std::vector<std::string>& expected, const std::vector<std::string>& actual) {
+    const auto size = std::min(expected.size(), actual.size());
+    const auto diverging = std::mismatch(expected.begin(), expected.begin() + static_cast<std::ptrdiff_t>(size), actual.begin());
+    const auto line = static_cast<std::size_t>(diverging.first - expected.begin());
+    if(line == size && expected.size() == actual.size())
+        return std::nullopt;
+    const auto at = [line](const auto& lines) {return line < lines.size() ? lines[line] : std::string("<end>");};
+    return Divergence{check, line + 1, at(expected), at(actual)};
+}
+
+/* The error lines refer to the line of the parser that found the error */
+std::vector<std::string> withoutRefs(const std::string& markdown) {
+    static const std::regex ref(R"(\(ref:\(-?\d+\))");
+    return splitLines(std::regex_replace(markdown, ref, "(ref:()"));
+}
+
+std::optional<Divergence> checkReference(const std::string& source) {
+    const auto expected = referenceMarkdown(source, "fuzz.h");
+    Collector optimised;
+    {
+        SourceParser parser("fuzz.h", optimised);
+        parser.parse(source);
+        parser.complete();
+    }
+    std::string actual;
+    for(const auto& line : optimised.lines()) {
+        actual += line;
+        actual += '\n';
+    }
+    return compare("regex", withoutRefs(expected), withoutRefs(actual));
+}
+
+std::optional<Divergence> checkParse(const std::string& source, bool streaming) {
+    Collector reference;
+    {
+        SourceParser parser("fuzz.h", reference, streaming);
+        for(const auto& line : splitLines(source)) {
+            if(!parser.parseLine(line))
+                break;
+        }
+        parser.complete();
+    }
+    Collector optimised;
+    {
+        SourceParser parser("fuzz.h", optimised, streaming);
+        parser.parse(source);
+        parser.complete();
+    }
+    return compare(streaming ? "parse (streaming)" : "parse", reference.lines(), optimised.lines());
+}
+
+std::optional<Divergence> checkParts(const std::string& source, std::mt19937& random) {
+    Collector reference;
+    {
+        SourceParser parser("fuzz.h", reference);
+        parser.parse(source);
+        parser.complete();
+    }
+    Collector appended;
+    {
+        const auto texts = SourceParser::split(source, std::uniform_int_distribution<std::size_t>(1, 256)(random));
+        std::vector<std::unique_ptr<SourceParser>> parts;
+        auto line = 0;
+        for(const auto& text : texts) {
+            parts.push_back(SourceParser::part("fuzz.h", appended, line));
+            parts.back()->parse(text);
+            line += static_cast<int>(std::count(text.begin(), text.end(), '\n'));
+        }
+        SourceParser parser("fuzz.h", appended);
+        for(auto i = 0U; i < texts.size() && parser.append(*parts[i], texts[i]); ++i);
+        parser.complete();
+    }
+    return compare("parts", reference.lines(), appended.lines());
+}
+
+std::optional<Divergence> checkStream(const std::string& source, std::mt19937& random) {
+    const auto expected = renderMarkdown(source, "fuzz.h");
+    std::string actual;
+    MarkdownStream stream("fuzz.h", [&actual](std::string_view markdown) {actual += markdown;});
+    for(std::size_t pos = 0; pos < source.size();) {
+        const auto size = std::uniform_int_distribution<std::size_t>(1, 64)(random);
+        stream.write(std::string_view(source).substr(pos, size));
+        pos += size;
+    }
+    stream.close();
+    return compare("stream", splitLines(expected), splitLines(actual));
+}
+
+/*
+ * The lines of a well formed declaration: types of identifiers, template arguments, '*' and '&' before the name.
+ * They are short, the regex backtracks on long ones.
+ */
+std::optional<Divergence> checkDeclaration(const std::string& source) {
+    static const std::regex command(R"(\*\s*@function\s+([a-zA-Z_][a-zA-Z0-9_]*))");
+    static const std::regex wellFormed(R"(^\s*(?:[A-Za-z_]\w*(?:::[A-Za-z_]\w*)*(?:<[\w:,*& ]*>)?[*&]*\s+)+([A-Za-z_]\w*)\s*\()");
+    static const std::regex function(R"((^\s*|[a-zA-Z0-9_<>*&:,]+\s)+([a-zA-Z_][a-zA-Z0-9_]*)\s*\(|<)");
+    static const std::regex functionTail(R"(^(.*\)($|\s?[a-zA-Z_]+)?))");
+    std::unordered_set<std::string> names;
+    for(auto it = std::sregex_iterator(source.begin(), source.end(), command); it != std::sregex_iterator(); ++it)
+        names.insert((*it)[1].str());
+    const auto lines = splitLines(source);
+    for(auto i = 0U; i < lines.size(); ++i) {
+        const auto& line = lines[i];
+        // the literals are skipped by DeclarationMatcher
+        std::smatch match;
+        if(line.size() > 160 || std::count(line.begin(), line.end(), '(') != 1 || std::count(line.begin(), line.end(), ')') != 1
+                || line.find(')') < line.find('(') || line.find_first_of("\"'") != std::string::npos
+                || !std::regex_search(line, match, wellFormed) || names.count(match[1].str()) == 0)
+            continue;
+        const auto name = match[1].str();
+        auto functionName = std::regex_replace(line, std::regex(R"(<[^>])"), "<>");
+        functionName = std::regex_replace(functionName, std::regex(R"(\([^\)])"), "()");
+        if(!std::regex_search(functionName, match, function) || match[2] != name || !std::regex_search(line, match, functionTail))
+            continue;
+        const auto expected = match[0].str();
+        DeclarationMatcher matcher;
+        const auto found = matcher.match(line, name) == DeclarationMatcher::Status::Found;
+        if(!found || matcher.declaration() != expected.substr(expected.find_first_not_of(" \t\n\v\f\r")))
+            return Divergence{"declaration", i + 1, expected, found ? matcher.declaration() : "<not found>"};
+    }
+    return std::nullopt;
+}
+
+/* A style and its value are taken from the lines of the source */
+std::optional<Divergence> checkStyle(const std::string& source, std::mt19937& random) {
+    const auto lines = splitLines(source);
+    if(lines.empty())
+        return std::nullopt;
+    const auto pick = [&lines, &random]() -> const std::string& {
+        return lines[std::uniform_int_distribution<std::size_t>(0, lines.size() - 1)(random)];
+    };
+    auto style = pick();
+    style.insert(std::uniform_int_distribution<std::size_t>(0, style.size())(random), "%1");
+    const auto& value = pick();
+    const std::string expected = std::regex_replace(style + " ", std::regex("%1"), value);
+    std::string actual;
+    StyleTemplate(style).render(actual, value);
+    return compare("style", {expected}, {actual});
+}
+
+/* @date is left out, the time could change between the renderings */
+std::optional<Divergence> check(std::string source, std::mt19937& random) {
+    for(auto pos = source.find("@date"); pos != std::string::npos; pos = source.find("@date", pos))
+        source[pos + 1] = '_';
+    const Quiet quiet;
+    if(auto divergence = checkReference(source))
+        return divergence;
+    for(const auto streaming : {false, true}) {
+        if(auto divergence = checkParse(source, streaming))
+            return divergence;
+    }
+    if(auto divergence = checkParts(source, random))
+        return divergence;
+    if(auto divergence = checkStream(source, random))
+        return divergence;
+    if(auto divergence = checkDeclaration(source))
+        return divergence;
+    return checkStyle(source, random);
+}
+
+/* Edits a few lines of the source with the constructs that the parser treats specially */
+std::string mutate(const std::string& source, std::mt19937& random) {
+    static const std::vector<std::string> Tokens {
+        "/**", "*/", " * ", "@function ", "@class ", "@namespace ", "@scope", "@scopeend", "@toc",
+        "@style ", "%1", "$&", "$`", "$'", "$$", "$1", "@raw ", "@eol", "@ignore", "@brief ", "@param ",
+        "@{x41}", "@{65}", "@{", "```", "~~~", "<", ">", "(", ")", "::", "template<typename T> ", "\r", "\t",
+        "fn(", "int fn(int a,", "\"", "'", "&", "MARKDOWNMAKER_EXPORT "
+    };
+    static const std::vector<std::string> Qualifiers {
+        " const", "const", " noexcept", " override", " = 0", " {", ";", " ", "\t", "const)", " /**/"
+    };
+    const auto number = [&random](std::size_t count) {return std::uniform_int_distribution<std::size_t>(0, count - 1)(random);};
+    auto lines = splitLines(source);
+    const auto edits = 1 + number(8);
+    for(auto i = 0U; i < edits; ++i) {
+        if(lines.empty())
+            lines.emplace_back();
+        auto& line = lines[number(lines.size())];
+        const auto copy = line;
+        switch(number(7)) {
+        case 0:
+            line.insert(number(line.size() + 1), Tokens[number(Tokens.size())]);
+            break;
+        case 1:
+            lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(number(lines.size() + 1)), Tokens[number(Tokens.size())]);
+            break;
+        case 2:
+            lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(number(lines.size())));
+            break;
+        case 3:
+            lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(number(lines.size() + 1)), copy);
+            break;
+        case 4:
+            if(!line.empty())
+                line.erase(number(line.size()), 1 + number(line.size()));
+            break;
+        case 5: { // at the end of a parameter list
+            std::vector<std::size_t> declarations;
+            for(auto l = 0U; l < lines.size(); ++l) {
+                if(lines[l].find(')') != std::string::npos)
+                    declarations.push_back(l);
+            }
+            if(declarations.empty())
+                break;
+            auto& declaration = lines[declarations[number(declarations.size())]];
+            declaration.insert(declaration.rfind(')') + 1, Qualifiers[number(Qualifiers.size())]);
+            break;
+        }
+        default:
+            if(!line.empty())
+                line[number(line.size())] = static_cast<char>(number(256));
+            break;
+        }
+    }
+    std::string out;
+    for(const auto& line : lines) {
+        out += line;
+        out += '\n';
+    }
+    if(!out.empty() && number(4) == 0)
+        out.pop_back(); // no newline at the end
+    return out;
+}
+
+CorpusOptions generatedOptions(std::mt19937& random, unsigned seed) {
+    const auto number = [&random](unsigned count) {return std::uniform_int_distribution<unsigned>(0, count - 1)(random);};
+    CorpusOptions options;
+    options.files = 1;
+    options.lines = 20 + number(400);
+    options.commentDensity = 0.1 + 0.1 * number(9);
+    options.nesting = number(4);
+    options.functions = number(12);
+    options.toc = number(2) == 0;
+    options.lineLength = 8 + number(100);
+    options.pathological = number(4) == 0;
+    options.seed = seed;
+    return options;
+}
+
+void report(const Divergence& divergence, const std::string& input) {
+    std::cerr << "Divergence in " << divergence.check << " at line " << divergence.line << " of " << input << std::endl;
+    std::cerr << "  reference: " << divergence.expected << std::endl;
+    std::cerr << "  optimised: " << divergence.actual << std::endl;
+}
+}
+
+#ifdef MDMAKER_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size) {
+    const std::string source(reinterpret_cast<const char*>(data), size);
+    std::mt19937 random(static_cast<unsigned>(size));
+    if(const auto divergence = check(source, random)) {
+        report(*divergence, "the input");
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char* argv[]) {
+    unsigned runs = 1000;
+    unsigned seed = 1;
+    std::string save = "mdmaker_fuzz_failure.h";
+    std::vector<std::string> files;
+
+    for(auto i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+        const auto p = arg.substr(1);
+        const bool hasValue = i < argc - 1;
+        if(p == "-runs" && hasValue) {
+            runs = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if(p == "-seed" && hasValue) {
+            seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if(p == "-save" && hasValue) {
+            save = argv[++i];
+        } else if(arg.front() == '-') {
+            std::cerr << "Unknown argument:" << arg << std::endl;
+            return -1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::vector<std::string> seeds;
+    for(const auto& f : files) {
+        std::ifstream file(f, std::ios::binary);
+        if(!file.is_open()) {
+            std::cerr << "Cannot open:" << f << std::endl;
+            return -1;
+        }
+        seeds.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::mt19937 random(seed);
+    const auto failed = [&save](const Divergence& divergence, const std::string& input, const std::string& source) {
+        report(divergence, input);
+        std::ofstream(save, std::ios::binary) << source;
+        std::cerr << "Input saved to " << save << std::endl;
+        return 1;
+    };
+    for(auto i = 0U; i < seeds.size(); ++i) {
+        if(const auto divergence = check(seeds[i], random))
+            return failed(*divergence, files[i], seeds[i]);
+    }
+    for(auto run = 0U; run < runs; ++run) {
+        const auto generated = seeds.empty() || run % 2 == 0;
+        const auto source = mutate(generated ? generateSource(generatedOptions(random, seed), run)
+                                             : seeds[run / 2 % seeds.size()], random);
+        if(const auto divergence = check(source, random))
+            return failed(*divergence, "run " + std::to_string(run) + " (seed " + std::to_string(seed) + ")", source);
+    }
+    std::cout << "No divergence in " << seeds.size() + runs << " inputs" << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,644 @@
+#include "jobserver.h"
+#include "markdownmaker.h"
+#include "filediscovery.h"
+#include "fragmentcache.h"
+#include "outputwriter.h"
+#include "workpool.h"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <optional>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+#ifndef WINDOWS_OS
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+/*
+ * The part of JSON the jobs need, numbers and literals are kept as their text
+ */
+struct Json {
+    enum class Type {Null, Literal, Number, String, Array, Object};
+    Type type = Type::Null;
+    std::string text;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+    const Json* member(std::string_view name) const {
+        const auto it = std::find_if(members.begin(), members.end(), [name](const auto& m) {return m.first == name;});
+        return it == members.end() ? nullptr : &it->second;
+    }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : m_text(text) {}
+    /* The value of the whole text */
+    std::optional<Json> document() {
+        auto value = read(0);
+        skipSpace();
+        if(!value || m_pos != m_text.size())
+            return std::nullopt;
+        return value;
+    }
+private:
+    static constexpr unsigned MaxDepth = 64;
+    void skipSpace() {
+        while(m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\r' || m_text[m_pos] == '\n'))
+            ++m_pos;
+    }
+    bool next(char c) {
+        skipSpace();
+        if(m_pos < m_text.size() && m_text[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+    std::optional<Json> read(unsigned depth);
+    std::optional<std::string> string();
+    bool codePoint(std::string& out);
+private:
+    const std::string_view m_text;
+    std::size_t m_pos = 0;
+};
+
+std::optional<Json> JsonReader::read(unsigned depth) {
+    skipSpace();
+    if(m_pos >= m_text.size() || depth > MaxDepth)
+        return std::nullopt;
+    Json value;
+    const auto c = m_text[m_pos];
+    if(c == '"') {
+        auto s = string();
+        if(!s)
+            return std::nullopt;
+        value.type = Json::Type::String;
+        value.text = std::move(*s);
+    } else if(c == '[' || c == '{') {
+        ++m_pos;
+        const auto object = c == '{';
+        value.type = object ? Json::Type::Object : Json::Type::Array;
+        if(next(object ? '}' : ']'))
+            return value;
+        do {
+            std::string name;
+            if(object) {
+                skipSpace();
+                auto s = m_pos < m_text.size() && m_text[m_pos] == '"' ? string() : std::nullopt;
+                if(!s || !next(':'))
+                    return std::nullopt;
+                name = std::move(*s);
+            }
+            auto item = read(depth + 1);
+            if(!item)
+                return std::nullopt;
+            if(object)
+                value.members.emplace_back(std::move(name), std::move(*item));
+            else
+                value.items.push_back(std::move(*item));
+        } while(next(','));
+        if(!next(object ? '}' : ']'))
+            return std::nullopt;
+    } else {
+        auto end = m_pos;
+        while(end < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[end])) || m_text[end] == '-'
+                                      || m_text[end] == '+' || m_text[end] == '.'))
+            ++end;
+        value.text = m_text.substr(m_pos, end - m_pos);
+        m_pos = end;
+        if(value.text == "null")
+            value.type = Json::Type::Null;
+        else if(value.text == "true" || value.text == "false")
+            value.type = Json::Type::Literal;
+        else if(!value.text.empty() && (value.text.front() == '-' || std::isdigit(static_cast<unsigned char>(value.text.front()))))
+            value.type = Json::Type::Number;
+        else
+            return std::nullopt;
+    }
+    return value;
+}
+
+std::optional<std::string> JsonReader::string() {
+    std::string s;
+    for(++m_pos; m_pos < m_text.size(); ++m_pos) {
+        const auto c = m_text[m_pos];
+        if(c == '"') {
+            ++m_pos;
+            return s;
+        }
+        if(c != '\\') {
+            s += c;
+            continue;
+        }
+        if(++m_pos == m_text.size())
+            break;
+        switch(m_text[m_pos]) {
+        case 'b': s += '\b'; break;
+        case 'f': s += '\f'; break;
+        case 'n': s += '\n'; break;
+        case 'r': s += '\r'; break;
+        case 't': s += '\t'; break;
+        case 'u':
+            if(!codePoint(s))
+                return std::nullopt;
+            break;
+        default: s += m_text[m_pos]; break;
+        }
+    }
+    return std::nullopt;
+}
+
+/* \uXXXX at the position, a surrogate pair is joined, as UTF-8 */
+bool JsonReader::codePoint(std::string& out) {
+    const auto hex = [this](std::size_t pos) -> std::optional<unsigned long> {
+        if(pos + 4 > m_text.size())
+            return std::nullopt;
+        unsigned long value = 0;
+        for(auto i = pos; i < pos + 4; ++i) {
+            const auto c = static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(m_text[i])));
+            if(!std::isxdigit(c))
+                return std::nullopt;
+            value = value * 16 + static_cast<unsigned long>(std::isdigit(c) ? c - '0' : c - 'a' + 10);
+        }
+        return value;
+    };
+    auto code = hex(m_pos + 1);
+    if(!code)
+        return false;
+    m_pos += 4;
+    if(*code >= 0xD800 && *code < 0xDC00 && m_text.substr(m_pos + 1, 2) == "\\u") {
+        const auto low = hex(m_pos + 3);
+        if(low && *low >= 0xDC00 && *low < 0xE000) {
+            code = 0x10000 + ((*code - 0xD800) << 10) + (*low - 0xDC00);
+            m_pos += 6;
+        }
+    }
+    if(*code < 0x80) {
+        out += static_cast<char>(*code);
+    } else if(*code < 0x800) {
+        out += static_cast<char>(0xC0 | (*code >> 6));
+        out += static_cast<char>(0x80 | (*code & 0x3F));
+    } else if(*code < 0x10000) {
+        out += static_cast<char>(0xE0 | (*code >> 12));
+        out += static_cast<char>(0x80 | ((*code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (*code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (*code >> 18));
+        out += static_cast<char>(0x80 | ((*code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((*code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (*code & 0x3F));
+    }
+    return true;
+}
+
+std::string jsonString(std::string_view s) {
+    std::ostringstream out;
+    out << '"';
+    for(const auto c : s) {
+        if(c == '"' || c == '\\')
+            out << '\\' << c;
+        else if(c == '\n')
+            out << "\\n";
+        else if(static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string jsonArray(const std::vector<std::string>& strings) {
+    std::string out = "[";
+    for(const auto& s : strings)
+        out += (out.size() > 1 ? ", " : "") + jsonString(s);
+    return out + "]";
+}
+
+std::optional<std::vector<std::string>> strings(const Json* value) {
+    std::vector<std::string> out;
+    if(!value)
+        return out;
+    if(value->type != Json::Type::Array)
+        return std::nullopt;
+    for(const auto& item : value->items) {
+        if(item.type != Json::Type::String)
+            return std::nullopt;
+        out.push_back(item.text);
+    }
+    return out;
+}
+
+/* The job of the request, the error is set if it is not valid */
+JobServer::Job readJob(const Json& request, std::string& error) {
+    JobServer::Job job;
+    const auto inputs = strings(request.member("inputs"));
+    const auto includes = strings(request.member("include"));
+    const auto excludes = strings(request.member("exclude"));
+    const auto output = request.member("output");
+    const auto depfile = request.member("depfile");
+    const auto styles = request.member("styles");
+    const auto jobs = request.member("jobs");
+    if(!inputs || inputs->empty())
+        error = "inputs is required";
+    else if(!output || output->type != Json::Type::String || output->text.empty())
+        error = "output is required";
+    else if(!includes || !excludes || (depfile && depfile->type != Json::Type::String)
+            || (styles && styles->type != Json::Type::Object) || (jobs && jobs->type != Json::Type::Number))
+        error = "invalid job";
+    if(!error.empty())
+        return job;
+    const auto directory = request.member("directory");
+    if(directory && directory->type == Json::Type::String)
+        job.directory = directory->text;
+    job.inputs = *inputs;
+    job.output = output->text;
+    job.depfile = depfile ? depfile->text : std::string();
+    job.includes = *includes;
+    job.excludes = *excludes;
+    if(styles) {
+        for(const auto& [name, style] : styles->members) {
+            if(style.type != Json::Type::String) {
+                error = "invalid style:" + name;
+                return job;
+            }
+            job.styles.emplace_back(name, style.text);
+        }
+    }
+    if(jobs) {
+        // as -j, and a job does not start more threads than the machine has
+        unsigned count = 0;
+        const auto end = jobs->text.data() + jobs->text.size();
+        const auto [last, ec] = std::from_chars(jobs->text.data(), end, count);
+        if(ec != std::errc() || last != end) {
+            error = "invalid jobs:" + jobs->text;
+            return job;
+        }
+        job.jobs = std::min(count, std::max(1U, std::thread::hardware_concurrency()));
+    }
+    return job;
+}
+
+std::string toJson(const JobServer::Job& job) {
+    std::string out = "{\"directory\": " + jsonString(job.directory) + ", \"inputs\": " + jsonArray(job.inputs)
+            + ", \"output\": " + jsonString(job.output);
+    if(!job.depfile.empty())
+        out += ", \"depfile\": " + jsonString(job.depfile);
+    if(!job.includes.empty())
+        out += ", \"include\": " + jsonArray(job.includes);
+    if(!job.excludes.empty())
+        out += ", \"exclude\": " + jsonArray(job.excludes);
+    if(!job.styles.empty()) {
+        out += ", \"styles\": {";
+        for(auto i = 0U; i < job.styles.size(); ++i)
+            out += (i > 0 ? ", " : "") + jsonString(job.styles[i].first) + ": " + jsonString(job.styles[i].second);
+        out += '}';
+    }
+    return out + ", \"jobs\": " + std::to_string(job.jobs) + "}";
+}
+}
+
+JobServer::JobServer() : m_cache(std::make_shared<FragmentCache>()) {
+}
+
+JobServer::~JobServer() {
+}
+
+int JobServer::run(const Job& job, std::string& error) {
+    const auto resolved = [&job](const std::string& path) {
+        return job.directory.empty() || path.empty() ? path : (std::filesystem::path(job.directory) / path).string();
+    };
+    const auto output = resolved(job.output);
+    const auto depfile = resolved(job.depfile);
+    FileDiscovery discovery;
+    discovery.setDirectory(job.directory);
+    for(const auto& glob : job.includes)
+        discovery.include(glob);
+    for(const auto& glob : job.excludes)
+        discovery.exclude(glob);
+    for(const auto& input : job.inputs) {
+        if(input.empty()) {
+            error = "Empty input";
+            return -1;
+        }
+        const bool listFile = input.size() > 1 && input.front() == '@';
+        std::error_code ec;
+        if(!discovery.add(input) || (!listFile && !std::filesystem::exists(resolved(input), ec))) {
+            error = "Cannot open:" + (listFile ? input.substr(1) : input);
+            return -1;
+        }
+    }
+    std::vector<std::string> read;
+    const auto inputs = discovery.discover(job.jobs > 0 ? job.jobs : std::thread::hardware_concurrency(), &read);
+
+    MarkdownMaker mm;
+    mm.setCache(m_cache);
+    if(m_sources)
+        mm.setSources(m_sources);
+    mm.setJobs(job.jobs);
+    for(const auto& [name, style] : job.styles)
+        mm.setStyle(name, style);
+    mm.setOutput(output);
+    if(!mm.hasOutput()) {
+        error = "Cannot open output:" + job.output;
+        return -1;
+    }
+    for(const auto& input : inputs) {
+        // the names are rendered as given, as in a run of the job in its directory
+        if(input.markup)
+            mm.addMarkupFile(input.name, input.path);
+        else
+            mm.addSourceFile(input.name, input.path);
+    }
+    const auto executed = mm.execute();
+    if(!mm.closeOutput()) {
+        error = "Cannot write output:" + job.output;
+        return -1;
+    }
+    if(!executed) {
+        error = "Cannot generate:" + job.output;
+        return -1;
+    }
+    if(!depfile.empty() && !writeDepfile(depfile, job.output, read)) {
+        error = "Cannot write output:" + job.depfile;
+        return -1;
+    }
+    return 0;
+}
+
+std::string JobServer::respond(std::string_view request) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto json = JsonReader(request).document();
+    std::string error;
+    std::string id = "null";
+    auto status = -1;
+    if(!json || json->type != Json::Type::Object) {
+        error = "invalid JSON";
+    } else {
+        const auto value = json->member("id");
+        if(value && value->type != Json::Type::Object && value->type != Json::Type::Array)
+            id = value->type == Json::Type::String ? jsonString(value->text) : value->text;
+        const auto job = readJob(*json, error);
+        if(error.empty())
+            status = run(job, error);
+    }
+    std::ostringstream response;
+    response << "{\"id\": " << id << ", \"status\": " << status << ", \"milliseconds\": "
+             << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(status != 0)
+        response << ", \"error\": " << jsonString(error);
+    response << "}";
+    return response.str();
+}
+
+/*
+ * The jobs share the rendered files as the jobs of a server, and the parsed sources too
+ */
+int JobServer::runManifest(std::istream& manifest) {
+    std::vector<std::pair<int, std::string>> lines;
+    std::string line;
+    for(auto number = 1; std::getline(manifest, line); ++number) {
+        if(line.find_first_not_of(" \t\r") != std::string::npos)
+            lines.push_back({number, std::move(line)});
+    }
+    m_sources = std::make_shared<SourceTable>();
+    std::vector<std::string> errors(lines.size());
+    WorkPool pool(std::max(1U, std::thread::hardware_concurrency()));
+    for(auto i = 0U; i < lines.size(); ++i) {
+        pool.submit([this, &lines, &errors, i]() {
+            const auto json = JsonReader(lines[i].second).document();
+            if(!json || json->type != Json::Type::Object) {
+                errors[i] = "invalid JSON";
+                return;
+            }
+            const auto job = readJob(*json, errors[i]);
+            if(errors[i].empty())
+                run(job, errors[i]);
+        });
+    }
+    pool.run();
+    m_sources.reset();
+    auto status = 0;
+    for(auto i = 0U; i < lines.size(); ++i) {
+        if(!errors[i].empty()) {
+            std::cerr << errors[i] << " (manifest line " << lines[i].first << ")" << std::endl;
+            status = -1;
+        }
+    }
+    return status;
+}
+
+/*
+ * Workers take the requests from a queue as they are read
+ */
+int JobServer::serve(std::istream& in, std::ostream& out) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::string> requests;
+    bool end = false;
+    const auto work = [this, &mutex, &changed, &requests, &end, &out]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            changed.wait(lock, [&requests, &end]() {return !requests.empty() || end;});
+            if(requests.empty())
+                return;
+            const auto request = std::move(requests.front());
+            requests.pop_front();
+            lock.unlock();
+            const auto response = respond(request);
+            lock.lock();
+            out << response << std::endl;
+        }
+    };
+    std::vector<std::thread> workers;
+    for(auto i = 0U; i < std::max(1U, std::thread::hardware_concurrency()); ++i)
+        workers.emplace_back(work);
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back(std::move(line));
+        }
+        changed.notify_one();
+    }
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        end = true;
+    }
+    changed.notify_all();
+    std::for_each(workers.begin(), workers.end(), [](auto& t){t.join();});
+    return 0;
+}
+
+#ifndef WINDOWS_OS
+
+static sockaddr_un socketAddress(const std::string& socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+static bool sendAll(int fd, std::string_view data) {
+    while(!data.empty()) {
+        const auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+/* Calls f for each line received until the connection is closed */
+template <typename F>
+static void receiveLines(int fd, F&& f) {
+    std::string buffer;
+    char data[4096];
+    for(;;) {
+        const auto received = ::recv(fd, data, sizeof(data), 0);
+        if(received < 0 && errno == EINTR)
+            continue;
+        if(received <= 0)
+            return;
+        buffer.append(data, static_cast<std::size_t>(received));
+        std::size_t pos = 0;
+        for(auto end = buffer.find('\n'); end != std::string::npos; end = buffer.find('\n', pos)) {
+            if(!f(std::string_view(buffer).substr(pos, end - pos)))
+                return;
+            pos = end + 1;
+        }
+        buffer.erase(0, pos);
+    }
+}
+
+/*
+ * Connections are queued as they are accepted and served by a fixed count of workers,
+ * each worker reads the jobs of a connection and runs them one at a time
+ */
+int JobServer::serve(const std::string& socketPath) {
+    if(socketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+        std::cerr << "Socket path is too long:" << socketPath << std::endl;
+        return -1;
+    }
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const auto address = socketAddress(socketPath);
+    ::unlink(socketPath.c_str()); // left by an earlier server
+    if(fd < 0 || ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen:" << socketPath << std::endl;
+        if(fd >= 0)
+            ::close(fd);
+        return -1;
+    }
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<int> connections;    // accepted, waiting for a worker
+    std::vector<int> served;        // read by a worker
+    bool end = false;
+    const auto work = [this, &mutex, &changed, &connections, &served, &end]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;) {
+            changed.wait(lock, [&connections, &end]() {return !connections.empty() || end;});
+            if(end)
+                return;
+            const auto connection = connections.front();
+            connections.pop_front();
+            served.push_back(connection);
+            lock.unlock();
+            receiveLines(connection, [this, connection](std::string_view request) {
+                return request.find_first_not_of(" \t\r") == std::string_view::npos
+                        || sendAll(connection, respond(request) + '\n');
+            });
+            lock.lock();
+            served.erase(std::find(served.begin(), served.end(), connection));
+            ::close(connection);
+        }
+    };
+    std::vector<std::thread> workers;
+    for(auto i = 0U; i < std::max(1U, std::thread::hardware_concurrency()); ++i)
+        workers.emplace_back(work);
+    for(;;) {
+        const auto connection = ::accept(fd, nullptr, nullptr);
+        if(connection < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            std::cerr << "Cannot accept:" << socketPath << std::endl;
+            break;
+        }
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            connections.push_back(connection);
+        }
+        changed.notify_one();
+    }
+    // the waiting connections are dropped, the served ones end after their current job
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        end = true;
+        std::for_each(connections.begin(), connections.end(), [](auto connection) {::close(connection);});
+        connections.clear();
+        std::for_each(served.begin(), served.end(), [](auto connection) {::shutdown(connection, SHUT_RDWR);});
+    }
+    changed.notify_all();
+    std::for_each(workers.begin(), workers.end(), [](auto& t){t.join();});
+    ::close(fd);
+    return -1;
+}
+
+int JobServer::forward(const std::string& socketPath, const Job& job) {
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const auto address = socketAddress(socketPath);
+    if(fd < 0 || socketPath.size() >= sizeof(address.sun_path)
+            || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "Cannot connect:" << socketPath << std::endl;
+        if(fd >= 0)
+            ::close(fd);
+        return -1;
+    }
+    std::optional<Json> response;
+    if(sendAll(fd, toJson(job) + '\n')) {
+        receiveLines(fd, [&response](std::string_view line) {
+            response = JsonReader(line).document();
+            return false;
+        });
+    }
+    ::close(fd);
+    const auto status = response ? response->member("status") : nullptr;
+    if(!status || status->type != Json::Type::Number) {
+        std::cerr << "No response:" << socketPath << std::endl;
+        return -1;
+    }
+    if(const auto error = response->member("error"))
+        std::cerr << error->text << std::endl;
+    return static_cast<int>(std::strtol(status->text.c_str(), nullptr, 10));
+}
+
+#else
+
+int JobServer::serve(const std::string& socketPath) {
+    std::cerr << "Sockets are not supported:" << socketPath << std::endl;
+    return -1;
+}
+
+int JobServer::forward(const std::string& socketPath, const Job&) {
+    std::cerr << "Sockets are not supported:" << socketPath << std::endl;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <utility>
+
+class FragmentCache;
+class SourceTable;
+
+/*
+ * Runs generation jobs in a long running process, so that a job does not pay the startup
+ * and the unchanged sources are not rendered again: the rendered files are kept in memory
+ * for the following jobs. Jobs are read one JSON object per line, e.g.
+ *
+ * {"id": 1, "inputs": ["include", "README.md"], "output": "doc/api.md", "depfile": "doc/api.d",
+ *  "styles": {"class": "## %1"}, "include": ["*.h"], "exclude": ["*_p.h"], "jobs": 2}
+ *
+ * and answered with a line {"id": 1, "status": 0, "milliseconds": 2.1}, or with an "error"
+ * if the status is not 0. Only the inputs and the output are required. The jobs run
+ * concurrently, so the responses come in the order of completion. Relative paths are
+ * taken from the "directory" of the job, by default the working directory of the server.
+ * Messages of the generation go to the stderr of the server.
+ */
+class JobServer {
+public:
+    struct Job {
+        std::string directory;              // of the relative paths, the server's if empty
+        std::vector<std::string> inputs;    // as INFILES of the command line
+        std::string output;
+        std::string depfile;                // if not empty, a make rule of the output
+        std::vector<std::string> includes;
+        std::vector<std::string> excludes;
+        std::vector<std::pair<std::string, std::string>> styles;
+        unsigned jobs = 1;
+    };
+public:
+    JobServer();
+    ~JobServer();
+    /* Reads the jobs until the end of the input, returns when they are all done */
+    int serve(std::istream& in, std::ostream& out);
+    /*
+     * Reads the jobs of each connection to the Unix domain socket, as many connections at a time
+     * as the machine has threads and the others queued, returns only on error
+     */
+    int serve(const std::string& socketPath);
+    /* Sends the job to the server listening the socket, returns the status of the job */
+    static int forward(const std::string& socketPath, const Job& job);
+    /* Runs the job, the error is set if the status is not 0 */
+    int run(const Job& job, std::string& error);
+    /*
+     * Runs the jobs of a manifest, one JSON object per line as read by serve, concurrently.
+     * Each source is parsed once for all the jobs and completed with the styles of each job.
+     * The errors are printed to stderr, returns 0 if all the jobs succeed.
+     */
+    int runManifest(std::istream& manifest);
+private:
+    std::string respond(std::string_view request);
+private:
+    const std::shared_ptr<FragmentCache> m_cache;
+    std::shared_ptr<SourceTable> m_sources;     // of a manifest
+};
+
+#endif // JOBSERVER_H
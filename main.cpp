@@ -1,27 +1,131 @@
 
 #include "markdownmaker.h"
+#include "filediscovery.h"
+#include "outputwriter.h"
+#include "jobserver.h"
+#include <filesystem>
 #include <iostream>
+#include <fstream>
+#include <thread>
+#include <charconv>
 
 std::string absoluteFilePath(const std::string& name);
 
+/* False if the value is not a number */
+static bool parseJobs(const std::string& value, unsigned& jobs) {
+    const auto end = value.data() + value.size();
+    const auto [last, ec] = std::from_chars(value.data(), end, jobs);
+    return ec == std::errc() && last == end;
+}
+
 int main(int argc, char* argv[]) {
    MarkdownMaker mm;
+   FileDiscovery discovery;
 
    std::vector<std::string> files;
+   std::string output;
+   bool watch = false;
+   std::string split;
+   auto splitBy = MarkdownMaker::SplitBy::File;
+   bool dependencies = false;
+   std::string depfile;
+   bool serve = false;
+   std::string socket;
+   std::string client;
+   std::string manifest;
+   bool local = false;    // options that a server does not take
+   bool instrumented = false; // options that --watch does not take
+   JobServer::Job job;
 
     for(auto i = 1 ; i < argc; i++) {
         std::string arg(argv[i]);
-        if(arg.front() == '-') {
+        const bool listFile = arg.size() > 1 && arg.front() == '@';
+        if(arg.empty()) {
+            std::cerr << "Empty input" << std::endl;
+            return -1;
+        } else if(arg.front() == '-') {
             auto p = arg.substr(1);
             if(p == "o" && i < argc - 1) {
-                mm.setOutput(argv[i + 1]);
+                output = argv[++i];
+            } else if((p == "j" && i < argc - 1) || (p.size() > 1 && p.front() == 'j')) {
+                if(!parseJobs(p == "j" ? argv[++i] : p.substr(1), job.jobs)) {
+                    std::cerr << "-j JOBS, a number of jobs" << std::endl;
+                    return -1;
+                }
+                mm.setJobs(job.jobs);
+            } else if(p == "-cache" && i < argc - 1) {
+                mm.setCacheDirectory(argv[++i]);
+                local = true;
+                instrumented = true;
+            } else if(p == "-watch") {
+                watch = true;
+            } else if(p == "-stats") {
+                mm.setStats(true);
+                local = true;
+                instrumented = true;
+            } else if(p == "-trace" && i < argc - 1) {
+                mm.setTrace(argv[++i]);
+                local = true;
+                instrumented = true;
+            } else if(p == "-index" && i < argc - 1) {
+                mm.setIndex(argv[++i]);
+                local = true;
+            } else if(p == "-include" && i < argc - 1) {
+                job.includes.push_back(argv[++i]);
+                discovery.include(job.includes.back());
+            } else if(p == "-exclude" && i < argc - 1) {
+                job.excludes.push_back(argv[++i]);
+                discovery.exclude(job.excludes.back());
+            } else if(p == "-serve") {
+                serve = true;
+            } else if(p == "-socket" && i < argc - 1) {
+                socket = argv[++i];
+            } else if(p == "-client" && i < argc - 1) {
+                client = argv[++i];
+            } else if(p == "-manifest" && i < argc - 1) {
+                manifest = argv[++i];
+            } else if(p == "-split" && i < argc - 1) {
+                split = argv[++i];
+            } else if(p == "-escape-md") {
+                mm.setEscapeMarkup(true);
+                local = true;
+            } else if(p == "MD") {
+                dependencies = true;
+            } else if(p == "MF" && i < argc - 1) {
+                dependencies = true;
+                depfile = argv[++i];
+            } else if(p == "-split-by" && i < argc - 1) {
+                const std::string by(argv[++i]);
+                if(by != "file" && by != "namespace") {
+                    std::cerr << "--split-by file or namespace" << std::endl;
+                    return -1;
+                }
+                splitBy = by == "file" ? MarkdownMaker::SplitBy::File : MarkdownMaker::SplitBy::Namespace;
             }
 
+        } else if(!discovery.add(arg)) {
+            std::cerr << "Cannot open:" << (listFile ? arg.substr(1) : arg) << std::endl;
+            return -1;
         } else {
             files.push_back(arg);
         }
     }
 
+    if(serve) {
+        JobServer server;
+        return socket.empty() ? server.serve(std::cin, std::cout) : server.serve(socket);
+    }
+
+    if(!manifest.empty()) {
+        std::ifstream file(manifest);
+        if(!file.is_open()) {
+            std::cerr << "Cannot open:" << manifest << std::endl;
+            return -1;
+        }
+        JobServer server;
+        return server.runManifest(file);
+    }
+
     if(files.size() == 0) {
         std::cerr << "<-o outfile> infiles" << std::endl;
         return -1;
@@ -29,25 +133,87 @@ int main(int argc, char* argv[]) {
 
 
 
-    if(!mm.hasOutput()){
+    if(watch && output.empty()) {
+        std::cerr << "--watch requires -o outfile" << std::endl;
+        return -1;
+    }
+
+    if(watch && instrumented) {
+        std::cerr << "--watch cannot be used with --cache, --stats or --trace" << std::endl;
+        return -1;
+    }
+
+    if(!split.empty() && (watch || !output.empty())) {
+        std::cerr << "--split cannot be used with --watch or -o" << std::endl;
+        return -1;
+    }
+
+    if(dependencies && (watch || output.empty())) {
+        std::cerr << "-MD requires -o outfile and cannot be used with --watch" << std::endl;
+        return -1;
+    }
+
+    if(dependencies && depfile.empty()) {
+        depfile = std::filesystem::path(output).replace_extension(".d").string();
+    }
+
+    if(!client.empty()) {
+        if(watch || !split.empty() || local || output.empty()) {
+            std::cerr << "--client takes only -j, -o, -MD, -MF, --include, --exclude and INFILES" << std::endl;
+            return -1;
+        }
+        // the server may run in another directory
+        job.directory = std::filesystem::current_path().string();
+        job.inputs = files;
+        job.output = output;
+        job.depfile = dependencies ? depfile : std::string();
+        return JobServer::forward(client, job);
+    }
+
+    if(!watch && split.empty() && !output.empty()) {
+        mm.setOutput(output);
+    }
+
+    if(!watch && split.empty() && !mm.hasOutput()){
         mm.setOutput("");
     }
 
     for(const auto& f : files) {
+        if(f.size() > 1 && f.front() == '@')
+            continue;
         const auto fname = absoluteFilePath(f);
-        if(fname.empty()) {
+        if(fname.empty() && !std::ifstream(f).is_open()) { // pipes have no real path
             std::cerr << "Cannot open:" << f << std::endl;
             return -1;
         }
-        if(toLower(f.substr(f.find_last_of(".") + 1)) == "md") {   
-            mm.addMarkupFile(f);
+    }
+
+    std::vector<std::string> read;
+    for(const auto& input : discovery.discover(std::max(1U, std::thread::hardware_concurrency()), &read)) {
+        if(input.markup) {
+            mm.addMarkupFile(input.name);
         } else {
-            mm.addSourceFile(f);
+            mm.addSourceFile(input.name);
         }
     }
 
-    mm.execute();
+    if(watch) {
+        return mm.watch(output);
+    }
+
+    if(!split.empty()) {
+        return mm.split(split, splitBy);
+    }
+
+    const auto executed = mm.execute();
+
+    if(!mm.closeOutput() || !executed) {
+        return -1;
+    }
+
+    if(dependencies && !writeDepfile(depfile, output, read)) {
+        return -1;
+    }
 
-  //  std::cout << mm.content() << std::endl;
     return 0;
 }
@@ -1,166 +1,832 @@
 #include "markdownmaker.h"
-#include <regex>
+#include "sourcereader.h"
+#include "outputwriter.h"
+#include "fragmentcache.h"
+#include "filewatcher.h"
+#include "textsearch.h"
+#include "pipelinestats.h"
+#include "parallelfor.h"
+#include "workpool.h"
+#include "declarationmatcher.h"
+#include <filesystem>
+#include <array>
 #include <iostream>
 #include <chrono>
 #include <ctime>
 #include <fstream>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <unordered_set>
+#include <numeric>
 
 #ifdef WINDOWS_OS
 #include <windows.h>
 #endif
 
+// with several jobs a source of at least twice the size is parsed in parts
+constexpr std::size_t SourcePartSize = 256 * 1024;
+
 constexpr char DefaultStyle[] = "##### %1";
+constexpr char Footer[] = "###### Generated by MarkdownMaker, (c) Markus Mertama 2020 ";
+
+constexpr std::pair<std::string_view, std::string_view> DefaultStyles[] = {
+    {"namespace", "### %1"},
+    {"class", "#### %1"},
+    {"param", "###### *Param:* %1"},
+    {"return", "###### *Return:* %1"},
+    {"templateparam", "###### *Template arg:* %1"},
+    {"brief", "###### %1"},
+    {"date", "###### %1"}
+};
+
+namespace {
+/*
+ * The @commands that have a meaning of their own, any other is a header using the style of its name
+ */
+enum class Command {Scope, Class, Namespace, Struct, Typedef, Toc, Date, ScopeEnd, Style, Function, Raw, Eol, Ignore, GlobalToc, Other};
 
-static bool isScope(const std::string& command) {
-    return command == "scope" || command == "class" || command == "namespace" || command == "struct";
+constexpr std::string_view CommandNames[] = {
+    "scope", "class", "namespace", "struct", "typedef", "toc", "date", "scopeend", "style", "function", "raw", "eol", "ignore", "globaltoc"
+};
+
+constexpr unsigned CommandHashSize = 32;
+
+constexpr unsigned commandHash(std::string_view name, unsigned seed) {
+    auto hash = static_cast<unsigned>(name.size());
+    for(const auto c : name)
+        hash = hash * seed + static_cast<unsigned char>(c);
+    return hash % CommandHashSize;
 }
 
+/*
+ * The first seed that hashes each command name to a slot of its own
+ */
+constexpr unsigned perfectSeed() {
+    for(auto seed = 1U;; ++seed) {
+        bool used[CommandHashSize] = {};
+        bool collision = false;
+        for(const auto name : CommandNames) {
+            const auto hash = commandHash(name, seed);
+            collision = collision || used[hash];
+            used[hash] = true;
+        }
+        if(!collision)
+            return seed;
+    }
+}
 
-static std::string htmlEscaped(const std::string& str) {
-    std::string out;
-    for(auto b : str) {
-        switch (b) {
+constexpr auto CommandSeed = perfectSeed();
+
+struct CommandTable {
+    Command slots[CommandHashSize];
+};
+
+constexpr CommandTable commandTable() {
+    CommandTable table{};
+    for(auto& slot : table.slots)
+        slot = Command::Other;
+    for(auto i = 0U; i < std::size(CommandNames); ++i)
+        table.slots[commandHash(CommandNames[i], CommandSeed)] = static_cast<Command>(i);
+    return table;
+}
+
+constexpr auto Commands = commandTable();
+}
+
+constexpr Command commandOf(std::string_view name) {
+    const auto command = Commands.slots[commandHash(name, CommandSeed)];
+    return command != Command::Other && CommandNames[static_cast<unsigned>(command)] == name ? command : Command::Other;
+}
+
+static_assert(commandOf("scopeend") == Command::ScopeEnd && commandOf("ignore") == Command::Ignore
+              && commandOf("param") == Command::Other, "command hash");
+
+static bool isScope(Command command) {
+    return command == Command::Scope || command == Command::Class || command == Command::Namespace || command == Command::Struct;
+}
+
+
+/*
+ * HTML escaped text, runs without the special characters are found with a vectorized search and copied as such
+ */
+static void appendEscaped(std::string& out, std::string_view str) {
+    constexpr std::string_view specials = "<>&\"'";
+    std::size_t pos = 0;
+    for(auto i = findAnyOf(str, specials); i != std::string_view::npos; i = findAnyOf(str, specials, pos)) {
+        out.append(str.substr(pos, i - pos));
+        switch (str[i]) {
         case '<': out += "&lt;"; break;
         case '>': out += "&gt;"; break;
         case '&': out += "&amp;"; break;
         case '"': out += "&quot;"; break;
-        case '\'': out+=  "&#39;"; break;
-        default: out += b;
+        default: out+=  "&#39;"; break;
+        }
+        pos = i + 1;
+    }
+    out.append(str.substr(pos));
+}
+
+/*
+ * Text of a markup file, a newline is added if the file does not end with one
+ */
+static void appendMarkup(std::string& out, std::string_view data, bool escape) {
+    if(escape)
+        appendEscaped(out, data);
+    else
+        out.append(data);
+    if(!data.empty() && data.back() != '\n')
+        out += '\n';
+}
+
+/*
+ * Writes the markup file as appendMarkup, an unescaped file is copied as it is
+ */
+static void writeMarkup(OutputWriter& writer, const std::string& fileName, std::string_view data, bool escape) {
+    if(escape) {
+        constexpr std::size_t Piece = 64 * 1024;
+        std::string escaped;
+        for(std::size_t pos = 0; pos < data.size(); pos += Piece) {
+            escaped.clear();
+            appendEscaped(escaped, data.substr(pos, Piece));
+            writer.write(escaped);
         }
+    } else {
+        writer.writeFile(fileName, data);
     }
+    if(!data.empty() && data.back() != '\n')
+        writer.write("\n");
+}
+
+static std::string htmlEscaped(std::string_view str) {
+    std::string out;
+    out.reserve(str.size());
+    appendEscaped(out, str);
     return out;
 }
 
 static std::string dateNow() {
+     static std::mutex mutex; // ctime is not reentrant
+     const std::lock_guard<std::mutex> lock(mutex);
      const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
      return std::ctime(&now);
 }
 
-static std::string replace(const std::string& where, const std::string& what, const std::string& how) {
-    std::regex re(what);
-    return std::regex_replace(where, re, how);
+/*
+ * Declaration without a leading export macro (e.g. MYLIB_EXPORT)
+ */
+static std::string withoutExport(const std::string& declaration) {
+    std::size_t word = 0;
+    while(word < declaration.size() && (std::isalnum(static_cast<unsigned char>(declaration[word])) || declaration[word] == '_'))
+        ++word;
+    const auto macro = declaration.rfind("_EXPORT", word < 7 ? 0 : word - 7);
+    return macro != std::string::npos && macro > 0 && macro + 7 <= word ? declaration.substr(macro + 7) : declaration;
+}
+
+namespace {
+/* Slug character of each byte: itself in lower case, a space or 0 if it is left out */
+constexpr std::array<char, 256> slugTable() {
+    std::array<char, 256> table{};
+    for(auto c = 'a'; c <= 'z'; ++c)
+        table[static_cast<unsigned char>(c)] = c;
+    for(auto c = 'A'; c <= 'Z'; ++c)
+        table[static_cast<unsigned char>(c)] = static_cast<char>(c - 'A' + 'a');
+    for(auto c = '0'; c <= '9'; ++c)
+        table[static_cast<unsigned char>(c)] = c;
+    table['_'] = '_';
+    table[' '] = ' ';
+    return table;
+}
+
+constexpr auto SlugChars = slugTable();
+constexpr std::string_view SlugEntities[] = {"&lt;", "&gt;", "&amp;", "&quot;"};
+}
+
+/*
+ * Anchor of a header as GitHub makes it: letters in lower case, digits and '_', words are
+ * joined with '-' and HTML entities and other characters are left out.
+ */
+static void appendSlug(std::string& out, std::string_view text) {
+    const auto start = out.size();
+    bool space = false;
+    for(std::size_t i = 0; i < text.size(); ++i) {
+        if(text[i] == '&') {
+            const auto entity = std::find_if(std::begin(SlugEntities), std::end(SlugEntities), [text, i](auto e) {
+                return text.size() - i >= e.size() && std::equal(e.begin(), e.end(), text.begin() + static_cast<std::ptrdiff_t>(i),
+                                                                  [](char a, char b) {return a == (b >= 'A' && b <= 'Z' ? b - 'A' + 'a' : b);});
+            });
+            if(entity != std::end(SlugEntities))
+                i += entity->size() - 1;
+            continue;
+        }
+        const auto c = SlugChars[static_cast<unsigned char>(text[i])];
+        if(c == ' ') {
+            space = out.size() > start;
+        } else if(c != 0) {
+            if(space)
+                out += '-';
+            out += c;
+            space = false;
+        }
+    }
+}
+
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool isLineEnd(char c) {
+    return c == '\n' || c == '\r';
 }
 
-static void replace(std::string& where, const std::string& what, const std::string& how) {
-   std::string out = replace(static_cast<const std::string&>(where), what, how);
-   where = out;
+static int digitValue(char c) {
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 16;
 }
 
-static std::string join(const std::stack<std::string>& stack) {
-    auto copy = stack;
-    std::string s;
-    while(!copy.empty()) {
-        const auto v = copy.top();
-        if(v == "_root")
+namespace {
+/*
+ * How the documentation text is transformed: Plain only decodes the @{...} codes,
+ * Html escapes the HTML special characters too and Example drops decoded newlines.
+ */
+enum class TextMode {Plain, Html, Example};
+
+enum class CodeMatch {None, Invalid, Code};
+}
+
+/*
+ * Match @{x41} or @{65} code at pos, matching the semantics of the former
+ * regex implementation (including the decimal value that skips its first digit).
+ */
+static CodeMatch matchCode(std::string_view line, std::size_t pos, std::size_t& end, unsigned long& code) {
+    if(pos + 2 >= line.size() || line[pos + 1] != '{')
+        return CodeMatch::None;
+    end = pos + 2;
+    const bool hex = line[end] == 'x' || line[end] == 'X';
+    if(hex) {
+        ++end;
+        while(end < line.size() && digitValue(line[end]) < 16)
+            ++end;
+    }
+    if(!hex || end == pos + 3) {
+        end = pos + 2;
+        while(end < line.size() && line[end] >= '0' && line[end] <= '9')
+            ++end;
+        if(end == pos + 2)
+            return CodeMatch::None;
+    }
+    if(end >= line.size() || line[end] != '}')
+        return CodeMatch::None;
+    const auto value = line.substr(pos + 2, end - pos - 2);
+    const auto base = value.front() == 'x' ? 16U : 10U;
+    code = 0;
+    auto count = 0U;
+    for(const auto c : value.substr(1)) {
+        const auto d = static_cast<unsigned>(digitValue(c));
+        if(d >= base)
             break;
-        if(!s.empty())
-            s.insert(0, v + "::");
-        else
-            s = v;
-          copy.pop();
+        code = std::min(code * base + d, 0x110000UL); // saturates, anything above is not a code point
+        ++count;
+    }
+    return count > 0 ? CodeMatch::Code : CodeMatch::Invalid;
+}
+
+static void appendTransformed(std::string& out, char c, TextMode mode) {
+    if(mode == TextMode::Html) {
+        switch (c) {
+        case '<': out += "&lt;"; return;
+        case '>': out += "&gt;"; return;
+        case '&': out += "&amp;"; return;
+        case '"': out += "&quot;"; return;
+        case '\'': out+=  "&#39;"; return;
+        default: break;
+        }
+    }
+    if(mode == TextMode::Example && c == '\n')
+        return;
+    out += c;
+}
+
+/*
+ * Code point as UTF-8, values that are not code points are written as U+FFFD
+ */
+static void appendCode(std::string& out, unsigned long code, TextMode mode) {
+    if(code < 0x80) {
+        appendTransformed(out, static_cast<char>(code), mode);
+        return;
     }
-    return s;
+    if(code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+        code = 0xFFFD;
+    const auto byte = [&out](unsigned long b) {out += static_cast<char>(b);};
+    if(code < 0x800) {
+        byte(0xC0 | (code >> 6));
+    } else if(code < 0x10000) {
+        byte(0xE0 | (code >> 12));
+        byte(0x80 | ((code >> 6) & 0x3F));
+    } else {
+        byte(0xF0 | (code >> 18));
+        byte(0x80 | ((code >> 12) & 0x3F));
+        byte(0x80 | ((code >> 6) & 0x3F));
+    }
+    byte(0x80 | (code & 0x3F));
 }
 
-static std::string replace(const std::string& where, const char what, const std::string& how) {
-    auto pos = 0U;
-    std::string replaced;
+/*
+ * Single pass over the documentation text that decodes the @{...} codes and
+ * escapes as the mode requires. Runs without any special characters are
+ * found with a vectorized search and copied as such. Returns false if the
+ * text has an invalid code.
+ */
+static bool appendDecoded(std::string& out, std::string_view text, TextMode mode) {
+    const std::string_view specials = mode == TextMode::Html ? "@<>&\"'" : "@\n";
+    out.reserve(out.size() + text.size() + text.size() / 8);
+    std::size_t pos = 0;
     for(;;) {
-        const auto index = where.find_first_of(what, pos);
-        if(index == std::string::npos)
+        const auto i = findAnyOf(text, specials, pos);
+        if(i == std::string_view::npos)
             break;
-        replaced += where.substr(pos, index - pos);
-        replaced += how;
-        pos = index + 1;
+        out.append(text.substr(pos, i - pos));
+        pos = i + 1;
+        std::size_t end;
+        unsigned long code;
+        const auto match = text[i] == '@' ? matchCode(text, i, end, code) : CodeMatch::None;
+        if(match == CodeMatch::Invalid)
+            return false;
+        if(match == CodeMatch::Code) {
+            appendCode(out, code, mode);
+            pos = end + 1;
+        } else {
+            appendTransformed(out, text[i], mode);
+        }
+    }
+    out.append(text.substr(pos));
+    return true;
+}
+
+static std::string decoded(std::string_view text, TextMode mode) {
+    std::string out;
+    if(!appendDecoded(out, text, mode))
+        return "INVALID";
+    return out;
+}
+
+static std::string decode(std::string_view line) {
+    return decoded(line, TextMode::Plain);
+}
+
+namespace {
+/*
+ * Part of a line, newline tells if the text extends to the end of the line
+ */
+struct LineText {
+    std::string_view text;
+    bool newline;
+};
+}
+
+/*
+ * Text after the first asterisk and its following whitespace, until the end of line
+ */
+static LineText removeAsterisk(std::string_view line) {
+    auto pos = line.find('*');
+    if(pos == std::string_view::npos)
+        return {line, true};
+    ++pos;
+    while(pos < line.size() && isSpace(line[pos]))
+        ++pos;
+    auto end = pos;
+    while(end < line.size() && !isLineEnd(line[end]))
+        ++end;
+    return {line.substr(pos, end - pos), end == line.size()};
+}
+
+namespace {
+/*
+ * Annotations found from a single line, the views refer to the scanned line.
+ */
+struct Tokens {
+    bool commentStart = false;  // /**
+    bool commentEnd = false;    // */
+    bool example1 = false;      // ```
+    bool example2 = false;      // ~~~
+    bool meta = false;          // * @command value\n
+    std::string_view command;
+    std::string_view value;
+};
+}
+
+/*
+ * Match '* @command value' at the given asterisk. The value ends to the end of line,
+ * or if the line contains a carriage return, to the last escaped newline before it.
+ */
+static bool scanMeta(std::string_view line, std::size_t pos, Tokens& tokens) {
+    ++pos;
+    while(pos < line.size() && isSpace(line[pos]))
+        ++pos;
+    if(pos >= line.size() || line[pos] != '@')
+        return false;
+    const auto commandStart = ++pos;
+    while(pos < line.size() && line[pos] >= 'a' && line[pos] <= 'z')
+        ++pos;
+    if(pos == commandStart)
+        return false;
+    const auto commandEnd = pos;
+    while(pos < line.size() && isSpace(line[pos]))
+        ++pos;
+    auto end = pos;
+    while(end < line.size() && !isLineEnd(line[end]))
+        ++end;
+    if(end == line.size()) {
+        tokens.meta = true;
+        tokens.command = line.substr(commandStart, commandEnd - commandStart);
+        tokens.value = line.substr(pos);
+        return true;
+    }
+    for(auto nl = end; nl >= pos + 2; --nl) {
+        if(line[nl - 2] == '\\' && line[nl - 1] == 'n') {
+            tokens.meta = true;
+            tokens.command = line.substr(commandStart, commandEnd - commandStart);
+            tokens.value = line.substr(pos, nl - 2 - pos);
+            return true;
+        }
     }
-    replaced += where.substr(pos);
-    return replaced;
+    return false;
 }
 
-static void replace(std::string& where, const char what, const std::string& how) {
-   std::string out = replace(static_cast<const std::string&>(where), what, how);
-   where = out;
+/*
+ * Single left-to-right pass over the line that finds all annotations
+ */
+static Tokens scan(std::string_view line) {
+    Tokens tokens;
+    const auto size = line.size();
+    for(auto i = 0U; i < size; ++i) {
+        switch(line[i]) {
+        case '*':
+            if(i + 1 < size && line[i + 1] == '/')
+                tokens.commentEnd = true;
+            if(!tokens.meta)
+                scanMeta(line, i, tokens);
+            break;
+        case '/':
+            if(i + 2 < size && line[i + 1] == '*' && line[i + 2] == '*')
+                tokens.commentStart = true;
+            break;
+        case '`':
+            if(i + 2 < size && line[i + 1] == '`' && line[i + 2] == '`')
+                tokens.example1 = true;
+            break;
+        case '~':
+            if(i + 2 < size && line[i + 1] == '~' && line[i + 2] == '~')
+                tokens.example2 = true;
+            break;
+        default:
+            break;
+        }
+    }
+    return tokens;
 }
 
 /*
-static std::string htmlEscaped(const std::string& str) {
-    const std::unordered_map<char, std::string> pairs {
-        {'"', "&quot;"},
-        {'&', "&amp;"},
-        {'\'', "&#39;"},
-        {'<', "&lt;"},
-        {'>', "&gt;"}};
-    std::string out = str;
-    for(const auto& [k, v] : pairs) {
-        replace(out, k, v);
+ * Backslash handling of the generated text: an escaped newline (\n) is removed and
+ * any other escaped character is written as-is.
+ */
+static std::string unescaped(std::string text) {
+    if(text.find('\\') == std::string::npos)
+        return text;
+    std::string removed;
+    removed.reserve(text.size());
+    for(auto i = 0U; i < text.size(); ++i) {
+        if(text[i] == '\\' && i + 1 < text.size() && text[i + 1] == 'n')
+            ++i;
+        else
+            removed += text[i];
+    }
+    std::string out;
+    out.reserve(removed.size());
+    for(auto i = 0U; i < removed.size(); ++i) {
+        if(removed[i] == '\\' && i + 1 < removed.size() && !isLineEnd(removed[i + 1]))
+            ++i;
+        out += removed[i];
     }
     return out;
 }
-*/
 
-static std::string trim(const std::string &cs) {
-    auto s  = cs;
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](auto ch) {
-        return !std::isspace(ch);}));
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](auto ch) {
-        return !std::isspace(ch);
-    }).base(), s.end());
-    return s;
+/*
+ * Example lines are written verbatim, followed by two spaces to keep the line break.
+ */
+static std::string exampleText(std::string text, bool newline) {
+    if(text.find('\\') == std::string::npos) {
+        text += "  ";
+        return text;
+    }
+    // backslashes are escaped so that only the escaped newlines are dropped
+    std::string escaped;
+    escaped.reserve(text.size() + text.size() / 4 + 5);
+    for(const auto c : text) {
+        if(c == '\\' || c == '"')
+            escaped += '\\';
+        escaped += c;
+    }
+    if(newline)
+        escaped += "\\\\n";
+    escaped += "  ";
+    return unescaped(std::move(escaped));
+}
+
+StyleMap defaultStyles() {
+    StyleMap styles;
+    for(const auto& [name, style] : DefaultStyles)
+        styles.emplace(name, StyleTemplate(style));
+    return styles;
+}
+
+const StyleTemplate& defaultStyle() {
+    static const StyleTemplate style(DefaultStyle);
+    return style;
+}
+
+StyleTemplate::StyleTemplate(std::string_view style) : m_text(style) {
+    m_text += ' ';
+    for(auto pos = m_text.find("%1"); pos != std::string::npos; pos = m_text.find("%1", pos + 2))
+        m_placeholders.push_back(pos);
+}
+
+/*
+ * Replace %1 in the style with the value, '$' sequences of the value are
+ * expanded as std::regex_replace format would do.
+ */
+void StyleTemplate::render(std::string& out, std::string_view value) const {
+    const bool plain = value.find('$') == std::string_view::npos;
+    std::size_t last = 0;
+    for(const auto pos : m_placeholders) {
+        out.append(m_text, last, pos - last);
+        if(plain) {
+            out.append(value);
+            last = pos + 2;
+            continue;
+        }
+        for(auto i = 0U; i < value.size(); ++i) {
+            if(value[i] != '$' || i + 1 == value.size()) {
+                out += value[i];
+                continue;
+            }
+            const auto c = value[++i];
+            if(c == '$')
+                out += '$';
+            else if(c == '&')
+                out += "%1";
+            else if(c == '`')
+                out.append(m_text, last, pos - last);
+            else if(c == '\'')
+                out.append(m_text, pos + 2);
+            else if(c >= '0' && c <= '9') {
+                auto num = c - '0';
+                if(i + 1 < value.size() && value[i + 1] >= '0' && value[i + 1] <= '9')
+                    num = num * 10 + value[++i] - '0';
+                if(num == 0)
+                    out += "%1";
+            } else {
+                out += '$';
+                --i;
+            }
+        }
+        last = pos + 2;
+    }
+    out.append(m_text, last);
+}
+
+SourceParser::SourceParser(const std::string& name, ContentManager& contentManager, bool streaming) :
+    m_sourceName(name), m_contentManager(contentManager), m_sink(contentManager.sink(name)), m_streaming(streaming) {
+    m_scopes.push_back({"_root", {}, {}, {}, {}});
+    m_scopeStack.push_back(0);
+    m_current = m_streaming ? &m_section : &m_scopes.front().content;
+}
+
+std::unique_ptr<SourceParser> SourceParser::part(const std::string& name, ContentManager& contentManager, int line) {
+    auto parser = std::make_unique<SourceParser>(name, contentManager);
+    parser->m_deferred = true;
+    parser->m_line = line;
+    return parser;
+}
+
+SourceParser::SourceParser(const SourceParser& parsed, ContentManager& contentManager, const std::string& sourceName) :
+    m_sourceName(sourceName), m_contentManager(contentManager), m_sink(contentManager.sink(sourceName)),
+    m_scopes(parsed.m_scopes), m_scopeStack(parsed.m_scopeStack), m_links(parsed.m_links), m_anchorSlugs(parsed.m_anchorSlugs), m_streaming(false),
+    m_line(parsed.m_line), m_docLines(parsed.m_docLines), m_dated(parsed.m_dated), m_globalToc(parsed.m_globalToc) {
+    m_current = &m_scopes[m_scopeStack.back()].content;
 }
 
-static std::string makeLink(const std::string& uri)  {
-    return replace(trim(replace(replace(toLower(trim(uri)), R"((&lt;)|(&gt;)|(&amp;)|(&quot;))", ""), R"([^\w ]+)", "")), R"(\s+)", "-");
+std::vector<std::string_view> SourceParser::split(std::string_view text, std::size_t size) {
+    std::vector<std::string_view> parts;
+    std::size_t start = 0;
+    for(auto pos = size; pos < text.size();) {
+        const auto next = findText(text, "/**", pos);
+        if(next == std::string_view::npos)
+            break;
+        const auto lineStart = text.rfind('\n', next);
+        if(lineStart != std::string_view::npos && lineStart + 1 > start) {
+            parts.push_back(text.substr(start, lineStart + 1 - start));
+            start = lineStart + 1;
+            pos = start + size;
+        } else {
+            pos = next + 3;
+        }
+    }
+    parts.push_back(text.substr(start));
+    return parts;
 }
 
+/*
+ * The part was parsed from outside of any documentation, if the text is there as well the
+ * deferred changes are done as they would have been when parsing. Otherwise (e.g. a comment
+ * start in a comment, or a @function declared after a comment) the text is parsed again.
+ */
+bool SourceParser::append(SourceParser& part, std::string_view text) {
+    if(m_state != State::Out || m_briefName)
+        return parse(text);
+    for(const auto& action : part.m_actions) {
+        m_line = action.line;
+        perform(action);
+    }
+    m_line = part.m_line;
+    m_docLines += part.m_docLines;
+    m_state = part.m_state;
+    m_declaration = part.m_declaration;
+    m_dated = m_dated || part.m_dated;
+    m_globalToc = m_globalToc || part.m_globalToc;
+    m_partArenas.push_back(std::move(part.m_arena));
+    return part.m_actions.empty() || part.m_actions.back().kind != Action::Kind::Stop;
+}
 
-/*This is maybe a bit clumsy as a quick port from the logic used with QRegularExpression*/
-static std::string decode(const std::string& line) {
-    std::string decoded;
-    const std::regex code(R"(@\{((?:x[0-9a-f]+)|(?:\d+))\})", std::regex::icase);
-    auto it = std::sregex_iterator(line.begin(), line.end(), code);
-    auto pos = 0U;
-    for(;it != std::sregex_iterator(); ++it) {
-        const auto match = *it;
-        const auto start = match.position();
-        decoded += line.substr(pos, start - pos);
-        const auto value = match[1].str();
-        try {
-        decoded += char(value.at(0) == 'x' ? std::stoi(value.substr(1), 0, 16) : std::stoi(value.substr(1)));
-        } catch(std::invalid_argument) {
-            return "INVALID";
+/*
+ * The qualified name of the scope is its path from the nearest scope named _root,
+ * scopes without a name are left out from the end (but not from the middle).
+ */
+void SourceParser::openScope(std::string_view name, bool isNamespace) {
+    if(m_deferred) {
+        m_actions.push_back({isNamespace ? Action::Kind::OpenNamespace : Action::Kind::Open, {Cmd::Add, {}, m_arena.add(name), {}}, m_line});
+        return;
+    }
+    const auto& parent = m_scopes[m_scopeStack.back()];
+    Scope scope{m_arena.intern(name), {}, {}, parent.section, {}};
+    if(m_scopeStack.size() == 1 && isNamespace)
+        scope.section = scope.name;
+    if(name != "_root") {
+        if(parent.name == "_root") {
+            scope.path = scope.name;
+        } else {
+            std::string path(parent.path);
+            path += "::";
+            path += name;
+            scope.path = m_arena.add(path);
         }
-        pos = match.position() + match.length();
+        scope.qualified = name.empty() ? parent.qualified : scope.path;
+    }
+    m_scopeStack.push_back(m_scopes.size());
+    m_scopes.push_back(std::move(scope));
+    if(m_streaming)
+        flush(false);
+    else
+        m_current = &m_scopes.back().content;
+}
+
+void SourceParser::closeScope() {
+    if(m_deferred) {
+        m_actions.push_back({Action::Kind::Close, {}, m_line});
+        return;
     }
-    decoded += line.substr(pos);
-    return decoded;
+    if(m_scopeStack.size() > 1) { // the root is never closed
+        m_scopeStack.pop_back();
+        // a streamed scope is already written, only the open ones are kept
+        if(m_streaming)
+            m_scopes.pop_back();
+    }
+    if(m_streaming)
+        flush(false);
+    else
+        m_current = &m_scopes[m_scopeStack.back()].content;
 }
 
-static std::string removeAsterisk(const std::string& line) {
-    const std::regex ast(R"(\s*\*\s*(.*))");
-    std::smatch match;
-    return std::regex_search(line, match, ast) ?
-                match[1].str() : line;
+void SourceParser::addLink(std::string_view name) {
+    if(m_deferred)
+        m_actions.push_back({Action::Kind::Link, {Cmd::Add, name, {}, {}}, m_line});
+    else
+        m_links.push_back({name, {}, m_line, {}});
 }
 
-SourceParser::SourceParser(const std::string& name, ContentManager& contentManager) :
-    m_sourceName(name), m_contentManager(contentManager) {
-    m_scopeStack.push("_root");
-    m_scopes.push_back("_root");
+/*
+ * Header of a class, namespace or typedef
+ */
+void SourceParser::addHeader(std::string_view name, std::string_view value) {
+    if(m_deferred) {
+        m_actions.push_back({Action::Kind::Header, {Cmd::Header, name, value, {}}, m_line});
+        return;
+    }
+    const auto anchor = makeAnchor(value);
+    m_links.push_back({name, value, m_line, anchor});
+    add(Cmd::Header, name, m_scopes[m_scopeStack.back()].qualified, anchor);
+}
+
+/*
+ * Header of a @function, its declaration is looked up from the following code
+ */
+void SourceParser::addFunction(std::string_view name, std::string_view value) {
+    if(m_deferred) {
+        m_actions.push_back({Action::Kind::Function, {Cmd::Header, name, value, {}}, m_line});
+        m_briefName = std::make_optional<std::pair<std::size_t, std::size_t>>({0, m_actions.size() - 1});
+    } else {
+        add(Cmd::Header, name, value);
+        m_briefName = std::make_optional<std::pair<std::size_t, std::size_t>>({m_scopeStack.back(), m_current->size() - 1});
+    }
+    m_declaration.reset();
+}
+
+void SourceParser::resolveFunction(std::string_view value) {
+    if(m_deferred) {
+        m_actions.push_back({Action::Kind::Found, {Cmd::Header, {}, value, {}}, m_line});
+    } else {
+        Content& content = pendingFunction();
+        const auto anchor = makeAnchor(value);
+        content = {Cmd::Header, content.name, value, anchor};
+        m_links.push_back({content.name, value, m_line, anchor});
+    }
+    m_briefName = std::nullopt;
+}
+
+void SourceParser::setStyle(std::string_view value) {
+    if(m_deferred) {
+        m_actions.push_back({Action::Kind::Style, {Cmd::Add, {}, m_arena.add(value), {}}, m_line});
+        return;
+    }
+    auto sep = value.find_first_of(' ');
+    if(sep > 0) {
+        m_contentManager.setStyle(std::string(value.substr(0, sep)), std::string(value.substr(sep + 1)));
+    } else {
+        m_contentManager.message("Invalid style" + std::string(value));
+    }
+}
+
+void SourceParser::perform(const Action& action) {
+    const auto& content = action.content;
+    switch(action.kind) {
+    case Action::Kind::Open:
+    case Action::Kind::OpenNamespace:
+        openScope(content.value, action.kind == Action::Kind::OpenNamespace);
+        break;
+    case Action::Kind::Close:
+        closeScope();
+        break;
+    case Action::Kind::Add:
+        add(content.cmd, content.name, content.value, content.uri);
+        break;
+    case Action::Kind::Link:
+        addLink(content.name);
+        break;
+    case Action::Kind::Header:
+        addHeader(content.name, content.value);
+        break;
+    case Action::Kind::Function:
+        addFunction(content.name, content.value);
+        break;
+    case Action::Kind::Found:
+        resolveFunction(content.value);
+        break;
+    case Action::Kind::Style:
+        setStyle(content.value);
+        break;
+    case Action::Kind::Error:
+    case Action::Kind::Message:
+        if(m_deferred) {
+            m_actions.push_back({action.kind, {Cmd::Add, {}, m_arena.add(content.value), {}}, action.line});
+            break;
+        }
+        m_contentManager.message(content.value);
+        if(action.kind == Action::Kind::Error)
+            appendLine(std::string(content.value) + "<br/>");
+        break;
+    case Action::Kind::Stop:
+        break;
+    }
 }
 
 bool SourceParser::fail(const std::string& s, int line) const {
-    auto err = decode(s + ", " + replace(m_sourceName, '\\', "/") + " at " +
+    std::string name(m_sourceName);
+    std::replace(name.begin(), name.end(), '\\', '/');
+    auto err = decode(s + ", " + name + " at " +
                       std::to_string(m_line) + " (ref:(" +
                       std::to_string(line) + ")");
-
-    replace(err, '\n', "");
-    replace(err, '\r', "");
-    replace(err, "\\n", "");
-    replace(err, "\\r", "");
-    replace(err, '"', "'");
-    replace(err, '\\', "");
-    std::cerr << err;
-    const_cast<SourceParser*>(this)->appendLine(err + "<br/>");
+    // the message is a single line without backslashes and double quotes
+    err.erase(std::remove_if(err.begin(), err.end(), [](char c) {return isLineEnd(c) || c == '\\';}), err.end());
+    std::replace(err.begin(), err.end(), '"', '\'');
+    const_cast<SourceParser*>(this)->perform({Action::Kind::Error, {Cmd::Add, {}, err, {}}, m_line});
     return true;
 }
 
@@ -169,262 +835,1156 @@ bool SourceParser::fail(const std::string& s, int line) const {
 SourceParser::~SourceParser() {
 }
 
-bool SourceParser::parseLine(const std::string& line) {
+bool SourceParser::parseLine(std::string_view line) {
     ++m_line;
+    const auto tokens = scan(line);
+    m_docLines += m_state != State::Out || tokens.commentStart;
     if(m_state != State::Out) {
-        const std::regex example1(R"(```)");
-        const std::regex example2(R"(\~\~\~)");
-        const std::regex blockCommentEnd(R"(\*/)");
-        const std::regex meta(R"(\s*\*\s*@([a-z]+)\s*(.*)(\\n))");
-        std::smatch match;
-        if(std::regex_search(line, match, blockCommentEnd)) {
+        if(tokens.commentEnd) {
             m_state = State::Out;
         } else {
-            std::smatch bm;
-            if(std::regex_search(line, bm, meta)) {
-                const auto command = bm[1].str();
-                const auto value = decode(bm[2].str());
+            if(tokens.meta) {
+                const auto command = commandOf(tokens.command);
+                // the known names are static, others are kept in the arena
+                const auto name = command != Command::Other ? CommandNames[static_cast<unsigned>(command)] : m_arena.intern(tokens.command);
+                const auto value = decode(tokens.value);
 
                 if(isScope(command)) {
-                    m_scopes.push_back(value);
-                    m_scopeStack.push(value);
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "\\n", ""});
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "---\\n", ""});
+                    openScope(value, command == Command::Namespace);
+                    add(Cmd::Add, {}, {});
+                    add(Cmd::Add, {}, "---");
                 }
 
-                if(command == "class" || command == "namespace" || command == "typedef") {
-                    m_links.push_back({command, value, m_line});
-                    m_content[m_scopeStack.top()].push_back({Cmd::Header, command, join(m_scopeStack), value});
-                }
-
-                else if(command == "toc") {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Toc, "", "", ""});
-                } else if(command == "date") {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Header, command, dateNow(), ""});
-                } else if(command == "scopeend") {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "\\n", ""});
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "---\\n", ""});
-                    m_scopeStack.pop();
-                    m_links.push_back({"scopeend", "", m_line});
-                } else if(command == "style") {
-                    auto sep = value.find_first_of(' ');
-                    if(sep > 0) {
-                        m_contentManager.setStyle(value.substr(0, sep), value.substr(sep + 1));
-                    } else {
-                        std::cerr << "Invalid style" << value;
-                    }
-                } else if(command == "function") {
-                    S_ASSERT(!m_briefName, "Only one brief or function allowed:" + line);
+                switch(command) {
+                case Command::Class:
+                case Command::Namespace:
+                case Command::Typedef:
+                    addHeader(name, m_arena.add(value));
+                    break;
+                case Command::Toc:
+                    m_hold = m_streaming;
+                    add(Cmd::Toc, {}, {});
+                    break;
+                case Command::GlobalToc:
+                    m_globalToc = true;
+                    add(Cmd::GlobalToc, {}, {});
+                    break;
+                case Command::Date:
+                    m_dated = true;
+                    add(Cmd::Header, name, recordText(dateNow()));
+                    break;
+                case Command::ScopeEnd:
+                    add(Cmd::Add, {}, {});
+                    add(Cmd::Add, {}, "---");
+                    closeScope();
+                    addLink(name);
+                    break;
+                case Command::Style:
+                    setStyle(value);
+                    break;
+                case Command::Function:
+                    S_ASSERT(!m_briefName, "Only one brief or function allowed:" + std::string(line) + "\\n");
                     S_ASSERT(m_scopeStack.size() > 0, "No top");
-                    m_content[m_scopeStack.top()].push_back({Cmd::Header, command, value});
-                    m_briefName = std::make_optional<std::pair<std::string, unsigned>>({m_scopeStack.top(),
-                                                      static_cast<unsigned>(
-                                                      m_content[m_scopeStack.top()].size()) - 1});
-                } else if(command == "raw") {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", value, ""});
-                } else if(command == "eol") {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "\\n", ""});
-                } else if(command == "ignore") {
-                   //ignore
-                } else {
-                    m_content[m_scopeStack.top()].push_back({Cmd::Header, command, value, ""});
+                    addFunction(name, recordText(value));
+                    break;
+                case Command::Raw:
+                    add(Cmd::Add, {}, recordText(unescaped(value)));
+                    break;
+                case Command::Eol:
+                    add(Cmd::Add, {}, {});
+                    break;
+                case Command::Ignore:
+                    break;
+                default: // scope and struct are headers as well
+                    add(Cmd::Header, name, recordText(value));
+                    break;
                 }
 
                 if(isScope(command)) {
-                    m_links.push_back({command, "", m_line});
+                    addLink(name);
                 }
 
-            } else if(m_state != State::Example2 && std::regex_search(line, match, example1)) {
+            } else if(m_state != State::Example2 && tokens.example1) {
                 if(m_state == State::In) {
                     m_state = State::Example1;
                 } else {
                     m_state = State::In;
                 }
-                m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "```\\n", ""});
-            } else if(m_state != State::Example1 && std::regex_search(line, match, example2)) {
+                add(Cmd::Add, {}, "```");
+            } else if(m_state != State::Example1 && tokens.example2) {
                 if(m_state == State::In) {
                     m_state = State::Example2;
                 } else {
                     m_state = State::In;
                 }
-                m_content[m_scopeStack.top()].push_back({Cmd::Add, "", "~~~\\n", ""});
+                add(Cmd::Add, {}, "~~~");
             } else if(m_state == State::In) {
-                const auto ref = decode(removeAsterisk(line));
-                m_content[m_scopeStack.top()].push_back({Cmd::Add, "", htmlEscaped(ref), ""});
+                const auto ref = removeAsterisk(line);
+                m_text.clear();
+                if(!appendDecoded(m_text, ref.text, TextMode::Html))
+                    m_text = "INVALID";
+                m_text = unescaped(std::move(m_text));
+                add(Cmd::Add, {}, recordText(m_text));
             } else if(m_state == State::Example1 || m_state == State::Example2) {
-                auto ref = decode(removeAsterisk(line));
-                replace(ref, '\n', "");
-                replace(ref, '\\', "\\\\");
-                replace(ref, '"', "\\\"");
-                m_content[m_scopeStack.top()].push_back({Cmd::Add, "", ref + "  \\n", ""});
+                const auto ref = removeAsterisk(line);
+                m_text.clear();
+                if(!appendDecoded(m_text, ref.text, TextMode::Example))
+                    m_text = "INVALID";
+                m_text = exampleText(std::move(m_text), ref.newline);
+                add(Cmd::Add, {}, recordText(m_text));
             }
         }
     } else {
         if(m_briefName) {
-            auto functionName = line;
-            replace(functionName, R"(<[^>])", "<>");
-            replace(functionName, R"(\([^\)])", "()");
-            const std::regex function(R"((^\s*|[a-zA-Z0-9_<>*&:,]+\s)+([a-zA-Z_][a-zA-Z0-9_]*)\s*\(|<)");
-            std::smatch match;
-            Content& content = m_content[m_briefName->first][m_briefName->second];
-            if(std::regex_search(functionName, match, function) && match[2] == content.value) {
-                const std::regex functionTail(R"(^(.*\)($|\s?[a-zA-Z_]+)?))");
-                if(!std::regex_search(line, match, functionTail)) {
-                    S_ASSERT(false, "Cannot understand as a function:" +line)
-                }
-                const auto v = trim(match[0]);
-                const auto value = htmlEscaped(replace(v, R"(^\s*\w+(_EXPORT))", ""));
-                const auto link = makeLink(value);
-                content = {Cmd::Header, content.name, value, link};
-                m_links.push_back({content.name, value, m_line});
-                m_briefName = std::nullopt;
+            Content& content = pendingFunction();
+            const auto status = m_declaration.match(line, content.value);
+            S_ASSERT(status != DeclarationMatcher::Status::TooLong, "Cannot understand as a function:" + std::string(line) + "\\n")
+            if(status == DeclarationMatcher::Status::Found) {
+                resolveFunction(m_arena.add(htmlEscaped(withoutExport(m_declaration.declaration()))));
             }
         }
-        const std::regex mdCommentStart(R"(/\*\*)");
-        std::smatch match;
-        if(std::regex_search(line, match, mdCommentStart)) {
+        if(tokens.commentStart) {
             m_state = State::In;
             S_ASSERT(!m_briefName, "function not found \\\""
-                     + m_content[m_briefName->first][m_briefName->second].value + "\\\"")
+                     + std::string(pendingFunction().value) + "\\\"")
         }
     }
     return true;
 }
 
 
-void SourceParser::complete() {
-    for(const auto& scope : m_scopes) {
-        for(const auto& line :  m_content[scope]) { //we cannot be async here as this has append in seq
-            switch(line.cmd) {
-            case Cmd::Add:
-                appendLine(line.value);
-                break;
-            case Cmd::Toc: {
-                int scopeDepth = 0;
-                for(const auto& link : m_links) {
-                    if(link.name == "scopeend") {
-                        --scopeDepth;
-                        continue;
-                    }
-                    else if(link.uri == "") {
-                        ++scopeDepth;
-                        continue;
-                    }
-                    if(scopeDepth < 0) {
-                        fail("Negative scope", link.line);
-                        break;
-                    }
-                    const auto uri = makeLink(link.uri);
-                    const std::string pre = scopeDepth > 0 ? std::string(2 * scopeDepth, ' ') + '*' : "*";
-                    const std::string name = isScope(link.name) ? " " + link.name + " " : " ";
-                    appendLine(pre + " [" + name + link.uri + " ](#" +  uri + ")" + "\\n");
-                }
-                if(scopeDepth != 0) {
-                    fail("Unbalanced scope (0 != " + std::to_string(scopeDepth) + ")", -1);
-                    break;
-                }
-                }
-                break;
-            case Cmd::Header: {
-                if(!line.uri.empty())
-                    appendLine("<a id=\"" + line.uri + "\"></a>");
-                appendLine(replace(m_contentManager.style(line.name) + " \\n", "%1", line.value));
-                break;
+bool SourceParser::parse(std::string_view text) {
+    std::size_t pos = 0;
+    while(pos < text.size()) {
+        if(m_state == State::Out) {
+            // outside of the comments only a comment start or the pending function declaration matters
+            auto next = findText(text, "/**", pos);
+            if(m_briefName) {
+                // every line of a declaration split to several lines is needed
+                const auto name = pendingFunction().value;
+                next = name.empty() || m_declaration.isIncomplete() ? pos : std::min(next, findText(text.substr(0, next), name, pos));
+            }
+            if(next == std::string_view::npos) {
+                const auto rest = text.substr(pos);
+                m_line += static_cast<int>(countChar(rest, '\n') + (rest.back() != '\n' ? 1 : 0));
+                return true;
             }
+            const auto lineStart = next > 0 ? text.rfind('\n', next - 1) : std::string_view::npos;
+            if(lineStart != std::string_view::npos && lineStart >= pos) {
+                m_line += static_cast<int>(countChar(text.substr(pos, lineStart + 1 - pos), '\n'));
+                pos = lineStart + 1;
             }
         }
+        const auto end = text.find('\n', pos);
+        const auto line = text.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+        if(!parseLine(line)) {
+            perform({Action::Kind::Message, {Cmd::Add, {}, "Parse error:" + std::string(line) + "\n", {}}, m_line});
+            if(m_deferred)
+                m_actions.push_back({Action::Kind::Stop, {}, m_line});
+            return false;
+        }
+        if(end == std::string_view::npos)
+            break;
+        pos = end + 1;
+    }
+    return true;
+}
+
+void SourceParser::collectStats(FileStats& stats) const {
+    stats.lines = static_cast<std::size_t>(m_line);
+    stats.docLines = static_cast<std::size_t>(m_docLines);
+    stats.links = m_links.size();
+    stats.records = 0;
+    // records are only added before complete
+    stats.peakBufferedBytes = m_arena.size() + m_sectionArena.size() + m_section.capacity() * sizeof(Content)
+            + m_scopes.capacity() * sizeof(Scope) + m_links.capacity() * sizeof(Link);
+    for(const auto& scope : m_scopes) {
+        stats.records += scope.content.size();
+        stats.peakBufferedBytes += scope.content.capacity() * sizeof(Content);
+    }
+    for(const auto& arena : m_partArenas)
+        stats.peakBufferedBytes += arena.size();
+}
+
+/*
+ * Writes the rendered line in m_text
+ */
+void SourceParser::appendText() {
+    if(m_text.find('\\') == std::string::npos)
+        appendLine(m_text);
+    else
+        appendLine(unescaped(m_text));
+}
+
+void Anchors::add(std::string& slug) {
+    const auto it = m_anchors.find(slug);
+    if(it != m_anchors.end()) {
+        const auto base = slug.size();
+        auto& count = it->second;
+        do {
+            slug.resize(base);
+            slug += '-';
+            slug += std::to_string(++count);
+        } while(m_anchors.find(slug) != m_anchors.end());
+    }
+    m_anchors.emplace(slug, 0);
+}
+
+/*
+ * The slug is kept for numbering the anchor again among the anchors of the whole output
+ */
+std::string_view SourceParser::makeAnchor(std::string_view text) {
+    m_slug.clear();
+    appendSlug(m_slug, text);
+    const auto slug = m_arena.add(m_slug);
+    m_anchorSlugs.push_back(slug);
+    m_anchors.add(m_slug);
+    return m_slug == slug ? slug : m_arena.add(m_slug);
+}
+
+std::vector<std::string_view> SourceParser::sections() const {
+    std::vector<std::string_view> sections;
+    for(auto i = 0U; i < m_scopes.size(); ++i) {
+        if(i == 0 || m_scopes[i].section != m_scopes[i - 1].section)
+            sections.push_back(m_scopes[i].section);
+    }
+    return sections;
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> SourceParser::anchorSections() const {
+    std::vector<std::pair<std::string_view, std::string_view>> anchors;
+    for(const auto& scope : m_scopes) {
+        for(const auto& record : scope.content) {
+            if(record.cmd == Cmd::Header && !record.uri.empty())
+                anchors.push_back({record.uri, scope.section});
+        }
+    }
+    return anchors;
+}
+
+void SourceParser::renderToc(const std::vector<Link>& links, const std::string& targetSource) {
+    int scopeDepth = 0;
+    for(const auto& link : links) {
+        const auto command = commandOf(link.name);
+        if(command == Command::ScopeEnd) {
+            --scopeDepth;
+            continue;
+        }
+        else if(link.uri.empty()) {
+            ++scopeDepth;
+            continue;
+        }
+        if(scopeDepth < 0) {
+            fail("Negative scope", link.line);
+            break;
+        }
+        m_text.assign(2 * static_cast<std::size_t>(scopeDepth), ' ');
+        m_text += "* [ ";
+        if(isScope(command)) {
+            m_text += link.name;
+            m_text += ' ';
+        }
+        m_text += link.uri;
+        m_text += " ](";
+        m_contentManager.appendLink(m_text, m_sourceName, m_renderSection, targetSource, link.anchor);
+        m_text += ')';
+        appendText();
+    }
+    if(scopeDepth != 0)
+        fail("Unbalanced scope (0 != " + std::to_string(scopeDepth) + ")", -1);
+}
+
+std::vector<SymbolIndex::Symbol> SourceParser::symbols() const {
+    std::vector<SymbolIndex::Symbol> symbols;
+    symbols.reserve(m_links.size());
+    for(const auto& link : m_links) {
+        const std::string text(link.uri);
+        symbols.push_back({std::string(link.name), text, std::string(link.anchor), link.line});
+    }
+    return symbols;
+}
+
+void SourceParser::render(const Content& record) {
+    switch(record.cmd) {
+    case Cmd::Add:
+        appendLine(record.value);
+        break;
+    case Cmd::Toc:
+        renderToc(m_links, m_sourceName);
+        break;
+    case Cmd::GlobalToc: {
+        const auto index = m_contentManager.symbolIndex();
+        if(!index) {
+            fail("globaltoc requires an index (--index)", -1);
+            break;
+        }
+        std::vector<Link> links;
+        for(const auto& entry : index->entries()) {
+            links.clear();
+            for(const auto& symbol : entry.symbols)
+                links.push_back({symbol.name, symbol.text, symbol.line, symbol.anchor});
+            renderToc(links, entry.file);
+        }
+        break;
+    }
+    case Cmd::Header: {
+        if(!record.uri.empty()) {
+            m_text = "<a id=\"";
+            m_text += m_contentManager.anchor(m_sourceName, record.uri);
+            m_text += "\"></a>";
+            appendText();
+        }
+        m_text.clear();
+        m_contentManager.style(record.name).render(m_text, record.value);
+        appendText();
+        break;
+    }
+    }
+}
+
+void SourceParser::flush(bool all) {
+    if(!all && (m_hold || m_briefName))
+        return;
+    for(const auto& record : m_section)
+        render(record);
+    m_section.clear();
+    m_sectionArena.clear();
+}
+
+void SourceParser::complete() {
+    if(m_streaming) {
+        flush(true);
+        return;
+    }
+    for(auto i = 0U; i < m_scopes.size(); ++i) {
+        const auto& scope = m_scopes[i];
+        if(i == 0 || scope.section != m_scopes[i - 1].section)
+            m_contentManager.beginSection(scope.section);
+        m_renderSection = scope.section;
+        for(const auto& record : scope.content) //we cannot be async here as this has append in seq
+            render(record);
     }
-    //completed();
+}
+
+MarkdownMaker::~MarkdownMaker() {
 }
 
 MarkdownMaker::MarkdownMaker() {
-    setStyle("namespace", "### %1");
-    setStyle("class", "#### %1");
-    setStyle("param", "###### *Param:* %1");
-    setStyle("return", "###### *Return:* %1");
-    setStyle("templateparam", "###### *Template arg:* %1");
-    setStyle("brief", "###### %1");
-    setStyle("date", "###### %1");
+    m_defaultStyles = defaultStyles();
+    m_styles = m_defaultStyles;
 
     contentChangedArray.push_back([this](){
         ++m_completed;
         if(m_completed == 0) {
-            appendLine("###### Generated by MarkdownMaker, (c) Markus Mertama 2020 \\n");
-        //    contentChanged();
-        //    allMade();
+            appendLine(Footer);
         }
     });
 }
 
 
 
-void MarkdownMaker::addMarkupFile(const std::string& mdFile) {
+void MarkdownMaker::addMarkupFile(const std::string& mdFile, const std::string& path) {
     --m_completed;
-    m_files.push_back({mdFile, [this, mdFile]() {
-        std::ifstream f(mdFile);
-        if(f.is_open()) {
-            std::string line;
-            while (std::getline(f, line)) {
-                //line  = replace(line, '\n', "\\n");
-                m_content[mdFile] += htmlEscaped(line + "\\n");
-            }
+    const auto filePath = path.empty() ? mdFile : path;
+    m_files.push_back({mdFile, filePath, [this, mdFile, filePath]() {
+        const SourceReader f(filePath);
+        if(f.isOpen()) {
+            for(const auto& writer : m_outputs)
+                writeMarkup(*writer, mdFile, f.data(), m_escapeMarkup);
         } else
              m_content[""] += "cannot load markup file:" + mdFile;
         contentChanged();
-        }});
+        }, false});
 }
 
 
-void MarkdownMaker::addSourceFile(const std::string& sourceFile) {
+/*
+ * Private output of a source file parsed in a worker thread. Lines are kept
+ * until the file is completed in input order, and style changes are applied
+ * to the shared styles only then, therefore each file sees the styles as set
+ * by the files preceding it and by itself - as in the serial execution.
+ */
+class BufferedContent : public ContentManager {
+public:
+    BufferedContent(ContentManager& host) : m_host(host) {}
+    Sink sink(const std::string&) override {
+        return [this](std::string_view line) {
+            m_lines.emplace_back(line);
+        };
+    }
+    void setStyle(const std::string& name, const std::string& style) override {
+        m_styleChanges.push_back({name, style});
+    }
+    const StyleTemplate& style(std::string_view name) const override {
+        return m_host.style(name);
+    }
+    const SymbolIndex* symbolIndex() const override {
+        return m_host.symbolIndex();
+    }
+    std::string_view anchor(const std::string& sourceName, std::string_view anchor) const override {
+        return m_host.anchor(sourceName, anchor);
+    }
+    void appendLink(std::string& out, const std::string& sourceName, std::string_view section,
+                    const std::string& targetSource, std::string_view anchor) const override {
+        m_host.appendLink(out, sourceName, section, targetSource, anchor);
+    }
+    void commitStyles() {
+        for(const auto& [name, style] : m_styleChanges)
+            m_host.setStyle(name, style);
+    }
+    /* The messages are passed on when given and kept for the cache */
+    void message(std::string_view text) override {
+        m_host.message(text);
+        m_messages += text;
+    }
+    FragmentCache::Source cacheSource() const {
+        const auto& slugs = parser->anchorSlugs();
+        return {m_styleChanges, m_messages, {slugs.begin(), slugs.end()}};
+    }
+    void beginSection(std::string_view name) override {
+        m_sections.push_back({m_lines.size(), std::string(name)});
+    }
+    const std::vector<std::string>& lines() const {return m_lines;}
+    /* The first line and the top level namespace of each section */
+    const std::vector<std::pair<std::size_t, std::string>>& sections() const {return m_sections;}
+    void clearLines() {m_lines.clear(); m_sections.clear();}
+    bool opened = false;
+    std::unique_ptr<SourceParser> parser;
+    std::string contentKey;
+    std::optional<FragmentCache::Source> cached;
+    std::shared_ptr<const SourceTable::Source> source;
+    /* Completes the source of a table instead of parsing it, the lines are the ones written when parsed */
+    void use(std::shared_ptr<const SourceTable::Source> parsed, const std::string& sourceName, const std::string& path);
+private:
+    ContentManager& m_host;
+    FragmentCache::StyleChanges m_styleChanges;
+    std::string m_messages;
+    std::vector<std::string> m_lines;
+    std::vector<std::pair<std::size_t, std::string>> m_sections;
+};
+
+/*
+ * A parsed source of a table, with the lines written and the styles set when parsing
+ */
+struct SourceTable::Source {
+    class Content : public ContentManager {
+    public:
+        Sink sink(const std::string&) override {
+            return [this](std::string_view line) {lines.emplace_back(line);};
+        }
+        void setStyle(const std::string& name, const std::string& style) override {styleChanges.push_back({name, style});}
+        const StyleTemplate& style(std::string_view) const override {return defaultStyle();}
+        void message(std::string_view text) override {messages += text;}
+        std::vector<std::string> lines;
+        FragmentCache::StyleChanges styleChanges;
+        std::string messages;
+    };
+    std::once_flag parsed;
+    Content content;
+    std::unique_ptr<SourceParser> parser;
+    std::string contentHash;
+};
+
+SourceTable::SourceTable() {
+}
 
-    --m_completed;
-    //connect(parser, &SourceParser::appendLine, this, &MarkdownMaker::appendLine);
-    appendLineArray.push_back([this, sourceFile](const std::string& append) {
-        m_content[sourceFile] += append;
+SourceTable::~SourceTable() {
+}
+
+std::shared_ptr<const SourceTable::Source> SourceTable::source(const std::string& fileName) {
+    std::error_code ec;
+    const auto path = std::filesystem::absolute(fileName, ec).lexically_normal().string();
+    std::shared_ptr<Source> source;
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        auto& entry = m_sources[ec ? fileName : path];
+        if(!entry)
+            entry = std::make_shared<Source>();
+        source = entry;
+    }
+    // the others using the source wait until it is parsed
+    std::call_once(source->parsed, [&source, &fileName]() {
+        const SourceReader file(fileName);
+        if(!file.isOpen())
+            return;
+        source->contentHash = FragmentCache::contentHash(file.data());
+        source->parser = std::make_unique<SourceParser>(fileName, source->content);
+        source->parser->parse(file.data());
     });
+    return source->parser ? source : nullptr;
+}
 
-        m_files.push_back({sourceFile, [this, sourceFile]() {
-            std::ifstream file(sourceFile);
-            if(file.is_open()) {
-                SourceParser parser(sourceFile, *this);
-                std::string line;
-                while (std::getline(file, line)) {
-               // replace(line, '\r', ""); //DOS line endings
-              //  if(!parser->parseLine(replace(line, '\n', "\\n"))) {
-                  if(!parser.parseLine(line + "\\n")) {
-                    std::cerr << "Parse error:" << line << std::endl;
-                    break;
-                  }
-                }
-                parser.complete();
+
+static std::unique_ptr<SourceParser> parseSource(const std::string& sourceFile, const SourceReader& file, ContentManager& contentManager,
+                                                 FileStats* stats = nullptr, Tracer* tracer = nullptr) {
+    auto parser = std::make_unique<SourceParser>(sourceFile, contentManager);
+    {
+        const Span span(stats ? &stats->parseSeconds : nullptr, tracer, "parse", sourceFile);
+        parser->parse(file.data());
+    }
+    if(stats) {
+        stats->bytes = file.data().size();
+        parser->collectStats(*stats);
+    }
+    return parser;
+}
+
+static std::unique_ptr<SourceParser> parseSourceFile(const std::string& sourceFile, const std::string& path, ContentManager& contentManager,
+                                                     FileStats* stats = nullptr, Tracer* tracer = nullptr) {
+    const SourceReader file(path);
+    if(!file.isOpen())
+        return nullptr;
+    return parseSource(sourceFile, file, contentManager, stats, tracer);
+}
+
+/*
+ * The messages given when parsing may tell the name of the source, a source that gave
+ * any is parsed again by each generation with the name it gives to the source.
+ */
+void BufferedContent::use(std::shared_ptr<const SourceTable::Source> parsed, const std::string& sourceName, const std::string& path) {
+    if(!parsed->content.messages.empty()) {
+        parser = parseSourceFile(sourceName, path, *this);
+        return;
+    }
+    m_lines = parsed->content.lines;
+    m_styleChanges = parsed->content.styleChanges;
+    parser = std::make_unique<SourceParser>(*parsed->parser, *this, sourceName);
+    source = std::move(parsed);
+}
+
+namespace {
+/* Parts of a source parsed in the tasks of a pool */
+struct SourceParts {
+    std::shared_ptr<const SourceReader> file;
+    std::vector<std::string_view> texts;
+    std::vector<std::unique_ptr<SourceParser>> parsers;
+    std::vector<double> seconds;
+    std::atomic<std::size_t> left{0};
+};
+}
+
+/*
+ * Parses a large source in parts of the pool, the task completing the last part
+ * appends them all in order to the parser of the source
+ */
+static void parseSourceParts(WorkPool& pool, const std::string& sourceFile, std::shared_ptr<const SourceReader> file,
+                             BufferedContent& buffer, FileStats* stats, Tracer* tracer) {
+    const auto parts = std::make_shared<SourceParts>();
+    parts->file = std::move(file);
+    parts->texts = SourceParser::split(parts->file->data(), SourcePartSize);
+    parts->seconds.resize(parts->texts.size());
+    parts->left = parts->texts.size();
+    auto line = 0;
+    for(const auto& text : parts->texts) {
+        parts->parsers.push_back(SourceParser::part(sourceFile, buffer, line));
+        line += static_cast<int>(countChar(text, '\n'));
+    }
+    for(auto i = 0U; i < parts->texts.size(); ++i) {
+        pool.submit([parts, i, &sourceFile, &buffer, stats, tracer]() {
+            {
+                const Span span(stats ? &parts->seconds[i] : nullptr, tracer, "parse", sourceFile);
+                parts->parsers[i]->parse(parts->texts[i]);
+            }
+            if(--parts->left > 0)
+                return;
+            auto parser = std::make_unique<SourceParser>(sourceFile, buffer);
+            {
+                const Span span(stats ? &stats->parseSeconds : nullptr, tracer, "append", sourceFile);
+                for(auto p = 0U; p < parts->texts.size() && parser->append(*parts->parsers[p], parts->texts[p]); ++p)
+                    parts->parsers[p].reset();
+            }
+            if(stats) {
+                for(const auto seconds : parts->seconds)
+                    stats->parseSeconds += seconds;
+                stats->bytes = parts->file->data().size();
+                parser->collectStats(*stats);
+            }
+            buffer.parser = std::move(parser);
+        });
+    }
+}
+
+void MarkdownMaker::addSourceFile(const std::string& sourceFile, const std::string& path) {
+
+    --m_completed;
+
+        const auto filePath = path.empty() ? sourceFile : path;
+        m_files.push_back({sourceFile, filePath, [this, sourceFile, filePath]() {
+            const auto parser = parseSourceFile(sourceFile, filePath, *this);
+            if(parser) {
+                claimAnchors(sourceFile, parser->anchorSlugs());
+                parser->complete();
             } else {
-                    m_content[""] += "cannot load source file:" + sourceFile;
-                    std::cerr << "Cannot open file:" << sourceFile << std::endl;
+                    sourceFileFailed(sourceFile);
                 }
             contentChanged();
-            }});
+            }, true});
+}
+
+void MarkdownMaker::sourceFileFailed(const std::string& sourceFile) {
+    m_content[""] += "cannot load source file:" + sourceFile;
+    std::cerr << "Cannot open file:" << sourceFile << std::endl;
+}
+
+void ContentManager::message(std::string_view text) {
+    std::cerr << text;
+}
+
+ContentManager::Sink MarkdownMaker::sink(const std::string& sourceName) {
+    auto& content = m_content[sourceName]; // references to map elements are stable
+    return [this, &content](std::string_view line) {
+        content += line;
+        content += '\n';
+        appendLine(line);
+    };
 }
 
 std::string MarkdownMaker::content() const {
+    std::size_t size = 0;
+    for(const auto& file : m_files) {
+        const auto it = m_content.find(file.name);
+        if(it != m_content.end())
+            size += it->second.size();
+    }
     std::string data;
+    data.reserve(size);
     for(const auto& file : m_files) {
-        data += m_content.at(file.first);
+        const auto it = m_content.find(file.name);
+        if(it != m_content.end()) {
+            data += it->second;
+        } else if(!file.source) {  // markup files are written to the outputs only
+            const SourceReader markup(file.path);
+            appendMarkup(data, markup.data(), m_escapeMarkup);
+        }
     }
     return data;
 }
 
-void MarkdownMaker::execute() {
-    std::for_each(m_files.begin(), m_files.end(), [](const auto& f){f.second();});
+void MarkdownMaker::setJobs(unsigned jobs) {
+    m_jobs = jobs > 0 ? jobs : std::max(1U, std::thread::hardware_concurrency());
+}
+
+void MarkdownMaker::setCacheDirectory(const std::string& directory) {
+    m_cache = std::make_shared<FragmentCache>(directory);
+    m_reportCache = true;
+}
+
+void MarkdownMaker::setCache(std::shared_ptr<FragmentCache> cache) {
+    m_cache = std::move(cache);
+    m_reportCache = false;
+}
+
+void MarkdownMaker::setSources(std::shared_ptr<SourceTable> sources) {
+    m_sources = std::move(sources);
+}
+
+std::string MarkdownMaker::stylesKey() const {
+    std::vector<std::pair<std::string, std::string>> styles; // the map is sorted by name
+    for(const auto& [name, style] : m_styles)
+        styles.push_back({name, std::string(style.source())});
+    return FragmentCache::stylesKey(styles);
+}
+
+void MarkdownMaker::setStats(bool stats) {
+    m_stats = stats ? std::make_unique<PipelineStats>() : nullptr;
+}
+
+void MarkdownMaker::setTrace(const std::string& traceFile) {
+    m_tracer = std::make_unique<Tracer>(traceFile);
+}
+
+void MarkdownMaker::setIndex(const std::string& indexFile) {
+    m_index = std::make_unique<SymbolIndex>(indexFile);
+}
+
+/*
+ * The index is updated with the parsed files before any file is completed, so that
+ * @globaltoc sees the links of the files after it as well.
+ */
+bool MarkdownMaker::updateIndex(const Buffers& buffers) {
+    if(!m_index)
+        return true;
+    std::vector<std::string> files;
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        if(!m_files[i].source || buffers[i]->contentKey.empty())
+            continue;
+        if(buffers[i]->parser)
+            m_index->set(m_files[i].name, buffers[i]->contentKey, buffers[i]->parser->symbols());
+        files.push_back(m_files[i].name);
+    }
+    m_index->retain(files);
+    return m_index->save();
+}
+
+std::unordered_map<std::string, std::string> MarkdownMaker::claimAnchors(const std::string& sourceName, const std::vector<std::string_view>& slugs) {
+    Anchors own;
+    std::unordered_map<std::string, std::string> renamed;
+    for(const auto slug : slugs) {
+        std::string anchor(slug);
+        std::string output(slug);
+        own.add(anchor);
+        m_anchors.add(output);
+        if(anchor != output)
+            renamed.emplace(std::move(anchor), std::move(output));
+    }
+    if(renamed.empty())
+        m_renamedAnchors.erase(sourceName);
+    else
+        m_renamedAnchors[sourceName] = renamed;
+    return renamed;
+}
+
+const std::string& MarkdownMaker::documentOf(const std::string& sourceName, std::string_view section) const {
+    static const std::string index("index.md");
+    const auto it = m_documents.find(*m_splitBy == SplitBy::File ? sourceName : std::string(section));
+    return it == m_documents.end() ? index : it->second;
+}
+
+/*
+ * A link to an anchor in another split document tells the document
+ */
+void MarkdownMaker::appendLink(std::string& out, const std::string& sourceName, std::string_view section,
+                               const std::string& targetSource, std::string_view anchor) const {
+    if(m_splitBy) {
+        std::string_view targetSection;
+        const auto source = m_anchorSections.find(targetSource);
+        if(source != m_anchorSections.end()) {
+            const auto it = source->second.find(std::string(anchor));
+            if(it != source->second.end())
+                targetSection = it->second;
+        }
+        const auto& document = documentOf(targetSource, targetSection);
+        if(document != documentOf(sourceName, section))
+            out += document;
+    }
+    out += '#';
+    out += this->anchor(targetSource, anchor);
+}
+
+std::string_view MarkdownMaker::anchor(const std::string& sourceName, std::string_view anchor) const {
+    const auto source = m_renamedAnchors.find(sourceName);
+    if(source == m_renamedAnchors.end())
+        return anchor;
+    const auto it = source->second.find(std::string(anchor));
+    return it == source->second.end() ? anchor : std::string_view(it->second);
+}
+
+/*
+ * Parses the source files of the indices to new buffers, a large file in parts that the
+ * idle workers take from the worker that loaded it. When executing, a file is loaded from
+ * the cache if it is there and the parsing is timed for --stats and --trace.
+ */
+void MarkdownMaker::parseFiles(Buffers& buffers, const std::vector<std::size_t>& files, bool executing) {
+    buffers.resize(m_files.size());
+    const auto cache = executing ? m_cache.get() : nullptr;
+    const auto tracer = executing ? m_tracer.get() : nullptr;
+    WorkPool pool(m_jobs);
+    for(const auto i : files) {
+        buffers[i] = std::make_unique<BufferedContent>(*this);
+        if(!m_files[i].source)
+            continue;
+        pool.submit([this, i, &pool, &buffers, cache, tracer, executing]() {
+            const auto stats = executing && m_stats ? &m_stats->file(i) : nullptr;
+            const Span span(nullptr, tracer, "load", m_files[i].name);
+            auto& buffer = *buffers[i];
+            if(m_sources) {
+                // parsed once for all the generations sharing the table
+                buffer.source = m_sources->source(m_files[i].path);
+                buffer.opened = buffer.source != nullptr;
+                if(!buffer.opened)
+                    return;
+                buffer.contentKey = FragmentCache::sourceKey(m_files[i].name, buffer.source->contentHash);
+                if(cache && (!m_index || m_index->isCurrent(m_files[i].name, buffer.contentKey)))
+                    buffer.cached = cache->loadSource(buffer.contentKey);
+                if(!buffer.cached)
+                    buffer.use(buffer.source, m_files[i].name, m_files[i].path);
+                return;
+            }
+            const auto file = std::make_shared<const SourceReader>(m_files[i].path);
+            buffer.opened = file->isOpen();
+            if(!buffer.opened)
+                return;
+            if(cache || m_index)
+                buffer.contentKey = FragmentCache::contentKey(m_files[i].name, file->data());
+            // a cached file is parsed only if its links are not in the index
+            if(cache && (!m_index || m_index->isCurrent(m_files[i].name, buffer.contentKey))) {
+                buffer.cached = cache->loadSource(buffer.contentKey);
+                if(buffer.cached)
+                    return;
+            }
+            if(m_jobs > 1 && file->data().size() >= 2 * SourcePartSize)
+                parseSourceParts(pool, m_files[i].name, file, buffer, stats, tracer);
+            else
+                buffer.parser = parseSource(m_files[i].name, *file, buffer, stats, tracer);
+        });
+    }
+    pool.run();
+}
+
+bool MarkdownMaker::execute() {
+    m_anchors.clear();
+    m_renamedAnchors.clear();
+    if(m_jobs <= 1 && !m_cache && !m_stats && !m_tracer && !m_index && !m_sources) {
+        std::for_each(m_files.begin(), m_files.end(), [](const auto& f){f.execute();});
+        return true;
+    }
+
+    // instrumented runs are buffered to tell completing and writing apart
+    const auto tracer = m_tracer.get();
+    if(m_stats) {
+        std::vector<std::string> names;
+        std::transform(m_files.begin(), m_files.end(), std::back_inserter(names), [](const auto& f){return f.name;});
+        m_stats->setFiles(names);
+    }
+    const auto fileStats = [this](std::size_t i) {return m_stats ? &m_stats->file(i) : nullptr;};
+    const auto seconds = [](FileStats* stats, double FileStats::* member) {return stats ? &(stats->*member) : nullptr;};
+
+    Buffers buffers;
+    std::vector<std::size_t> inputs(m_files.size());
+    std::iota(inputs.begin(), inputs.end(), 0);
+    parseFiles(buffers, inputs, true);
+    const auto indexed = updateIndex(buffers);
+
+    // the anchors are numbered in input order before any file is completed, for @globaltoc
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        auto& buffer = *buffers[i];
+        if(buffer.parser) {
+            claimAnchors(m_files[i].name, buffer.parser->anchorSlugs());
+        } else if(buffer.cached) {
+            if(claimAnchors(m_files[i].name, {buffer.cached->anchors.begin(), buffer.cached->anchors.end()}).empty())
+                continue;
+            // a fragment is cached only with the anchors of the file itself
+            buffer.cached.reset();
+            if(buffer.source)
+                buffer.use(buffer.source, m_files[i].name, m_files[i].path);
+            else
+                buffer.parser = parseSourceFile(m_files[i].name, m_files[i].path, buffer, fileStats(i), tracer);
+        }
+    }
+
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        const Span span(nullptr, tracer, "file", m_files[i].name);
+        const auto stats = fileStats(i);
+        if(!m_files[i].source) {
+            {
+                const Span read(seconds(stats, &FileStats::parseSeconds), tracer, "read", m_files[i].name);
+                m_files[i].execute();
+            }
+            if(stats) {
+                std::error_code ec;
+                stats->bytes = static_cast<std::size_t>(std::filesystem::file_size(m_files[i].path, ec));
+                const SourceReader file(m_files[i].path);
+                stats->lines = countChar(file.data(), '\n') + (!file.data().empty() && file.data().back() != '\n');
+            }
+            continue;
+        }
+        auto& buffer = *buffers[i];
+        const auto output = sink(m_files[i].name);
+        if(buffer.cached) {
+            for(const auto& [name, style] : buffer.cached->styles)
+                setStyle(name, style);
+            const auto lines = m_cache->loadFragment(buffer.contentKey, stylesKey());
+            if(lines) {
+                m_cache->hit();
+                message(buffer.cached->messages);
+                const Span write(seconds(stats, &FileStats::writeSeconds), tracer, "write", m_files[i].name);
+                for(const auto& line : *lines)
+                    output(line);
+                contentChanged();
+                continue;
+            }
+            // rendered before only with other styles
+            if(buffer.source)
+                buffer.use(buffer.source, m_files[i].name, m_files[i].path);
+            else
+                buffer.parser = parseSourceFile(m_files[i].name, m_files[i].path, buffer, stats, tracer);
+        }
+        if(buffer.parser) {
+            buffer.commitStyles();
+            {
+                const Span complete(seconds(stats, &FileStats::completeSeconds), tracer, "complete", m_files[i].name);
+                buffer.parser->complete();
+            }
+            if(m_cache) {
+                m_cache->miss();
+                if(!buffer.parser->isDated() && !buffer.parser->hasGlobalToc() && m_renamedAnchors.count(m_files[i].name) == 0)
+                    m_cache->store(buffer.contentKey, stylesKey(), buffer.cacheSource(), buffer.lines());
+            }
+        }
+        const Span write(seconds(stats, &FileStats::writeSeconds), tracer, "write", m_files[i].name);
+        for(const auto& line : buffer.lines())
+            output(line);
+        if(!buffer.opened)
+            sourceFileFailed(m_files[i].name);
+        contentChanged();
+    }
+    if(m_cache && m_reportCache)
+        std::cerr << "Cache: " << m_cache->hits() << " hits, " << m_cache->misses() << " misses" << std::endl;
+    if(m_stats)
+        m_stats->report(std::cerr);
+    const auto traced = !m_tracer || m_tracer->write();
+    return indexed && traced;
+}
+
+int MarkdownMaker::watch(const std::string& output) {
+    std::vector<std::string> paths;
+    std::transform(m_files.begin(), m_files.end(), std::back_inserter(paths), [](const auto& f){return f.path;});
+    FileWatcher watcher(paths);
+    if(!watcher.isValid()) {
+        std::cerr << "Cannot watch files" << std::endl;
+        return -1;
+    }
+
+    Buffers buffers;
+    std::vector<std::string> renderedStyles(m_files.size());
+    std::vector<std::unordered_map<std::string, std::string>> renderedAnchors(m_files.size());
+    std::vector<std::size_t> inputs(m_files.size());
+    std::iota(inputs.begin(), inputs.end(), 0);
+    parseFiles(buffers, inputs, false);
+    if(!updateIndex(buffers))
+        return -1;
+
+    for(;;) {
+        // files are completed again only if they, the styles or the anchors in effect have changed
+        m_styles = m_defaultStyles;
+        m_anchors.clear();
+        m_renamedAnchors.clear();
+        std::vector<std::unordered_map<std::string, std::string>> renamed(m_files.size());
+        for(auto i = 0U; i < m_files.size(); ++i) {
+            if(buffers[i]->parser)
+                renamed[i] = claimAnchors(m_files[i].name, buffers[i]->parser->anchorSlugs());
+        }
+        auto writer = OutputWriter::replace(output);
+        if(!writer) {
+            std::cerr << "Cannot open output:" << output << std::endl;
+            return -1;
+        }
+        for(auto i = 0U; i < m_files.size(); ++i) {
+            auto& buffer = *buffers[i];
+            if(!m_files[i].source) {
+                const SourceReader file(m_files[i].path);
+                if(!file.isOpen())
+                    std::cerr << "Cannot open file:" << m_files[i].name << std::endl;
+                writeMarkup(*writer, m_files[i].name, file.data(), m_escapeMarkup);
+                continue;
+            }
+            if(!buffer.parser) {
+                std::cerr << "Cannot open file:" << m_files[i].name << std::endl;
+                continue;
+            }
+            buffer.commitStyles();
+            auto styles = stylesKey();
+            if(m_index && buffer.parser->hasGlobalToc()) // the toc changes with the other files
+                styles += '-' + std::to_string(m_index->revision());
+            if(styles != renderedStyles[i] || renamed[i] != renderedAnchors[i]) {
+                buffer.clearLines();
+                buffer.parser->complete();
+                renderedStyles[i] = styles;
+                renderedAnchors[i] = std::move(renamed[i]);
+            }
+            for(const auto& line : buffer.lines())
+                writer->writeLine(line);
+        }
+        writer->writeLine(Footer);
+        if(!writer->close())
+            return -1;
+
+        const auto changed = watcher.wait();
+        if(changed.empty())
+            return -1;
+        for(const auto i : changed)
+            renderedStyles[i].clear();
+        parseFiles(buffers, changed, false);
+        if(!updateIndex(buffers))
+            return -1;
+        for(const auto i : changed) {
+            std::error_code ec;
+            // a removed input is left out of the output until it is there again
+            std::cerr << (std::filesystem::exists(m_files[i].path, ec) ? "Updated:" : "Removed:") << m_files[i].name << std::endl;
+        }
+    }
+}
+
+/*
+ * File name of a document, made unique among the used names
+ */
+static std::string documentName(const std::string& title, std::unordered_set<std::string>& used) {
+    std::string base;
+    for(const auto c : title)
+        base += std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.' ? c : '_';
+    if(base.empty())
+        base = "_";
+    auto name = base + ".md";
+    for(auto n = 2U; !used.insert(name).second; ++n)
+        name = base + '-' + std::to_string(n) + ".md";
+    return name;
+}
+
+int MarkdownMaker::split(const std::string& directory, SplitBy splitBy) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if(ec) {
+        std::cerr << "Cannot create directory:" << directory << std::endl;
+        return -1;
+    }
+
+    Buffers buffers;
+    std::vector<std::size_t> inputs(m_files.size());
+    std::iota(inputs.begin(), inputs.end(), 0);
+    parseFiles(buffers, inputs, false);
+    if(!updateIndex(buffers))
+        return -1;
+    // completed in input order, as the styles set by a file apply to the files after it
+    struct Document {
+        std::string title;
+        std::string name;
+        std::vector<std::string_view> lines;
+    };
+    std::vector<Document> documents;
+    std::vector<std::string_view> outside; // lines outside of the namespaces go to the index page
+    std::unordered_map<std::string, std::size_t> namespaces;
+    std::vector<std::size_t> files(m_files.size()); // document of each file when split by file
+    std::unordered_set<std::string> used{"index.md"};
+    std::vector<std::string> markups(m_files.size()); // the lines of a markup file refer to its own text
+    const auto add = [&](const std::string& title, auto begin, auto end) {
+        auto& lines = title.empty() ? outside : documents[namespaces.at(title)].lines;
+        lines.insert(lines.end(), begin, end);
+    };
+
+    // the documents are known before any file is completed, as a link tells the document of its anchor
+    m_splitBy = splitBy;
+    m_documents.clear();
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        const auto parser = buffers[i]->parser.get();
+        if(m_files[i].source && !parser)
+            continue;
+        if(splitBy == SplitBy::File) {
+            files[i] = documents.size();
+            documents.push_back({m_files[i].name, documentName(std::filesystem::path(m_files[i].name).stem().string(), used), {}});
+            m_documents.emplace(m_files[i].name, documents.back().name);
+            continue;
+        }
+        if(!parser)
+            continue;
+        for(const auto section : parser->sections()) {
+            const std::string title(section);
+            if(title.empty() || namespaces.count(title) > 0)
+                continue;
+            namespaces[title] = documents.size();
+            documents.push_back({title, documentName(title, used), {}});
+            m_documents.emplace(title, documents.back().name);
+        }
+    }
+
+    // anchors are numbered in each document, in the order they are written to it
+    std::unordered_map<std::string, Anchors> documentAnchors;
+    m_renamedAnchors.clear();
+    m_anchorSections.clear();
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        if(!buffers[i]->parser)
+            continue;
+        const auto& parser = *buffers[i]->parser;
+        Anchors own;
+        std::unordered_map<std::string, std::string_view> slugs;
+        for(const auto slug : parser.anchorSlugs()) {
+            std::string anchor(slug);
+            own.add(anchor);
+            slugs.emplace(std::move(anchor), slug);
+        }
+        std::unordered_map<std::string, std::string> renamed;
+        auto& sections = m_anchorSections[m_files[i].name];
+        for(const auto& [anchor, section] : parser.anchorSections()) {
+            const std::string name(anchor);
+            const auto slug = slugs.find(name);
+            std::string output(slug == slugs.end() ? anchor : slug->second);
+            documentAnchors[documentOf(m_files[i].name, section)].add(output);
+            if(output != name)
+                renamed.emplace(name, std::move(output));
+            sections.emplace(name, section);
+        }
+        if(!renamed.empty())
+            m_renamedAnchors[m_files[i].name] = std::move(renamed);
+    }
+
+    for(auto i = 0U; i < m_files.size(); ++i) {
+        auto& buffer = *buffers[i];
+        std::vector<std::string_view> lines;
+        if(!m_files[i].source) {
+            const SourceReader file(m_files[i].path);
+            if(!file.isOpen())
+                m_content[""] += "cannot load markup file:" + m_files[i].name;
+            auto& text = markups[i];
+            appendMarkup(text, file.data(), m_escapeMarkup);
+            const std::string_view content(text);
+            for(std::size_t pos = 0; pos < content.size();) {
+                const auto end = content.find('\n', pos);
+                lines.push_back(content.substr(pos, end - pos));
+                pos = end == std::string_view::npos ? content.size() : end + 1;
+            }
+        } else if(buffer.parser) {
+            buffer.commitStyles();
+            buffer.parser->complete();
+            lines.assign(buffer.lines().begin(), buffer.lines().end());
+        } else {
+            std::cerr << "Cannot open file:" << m_files[i].name << std::endl;
+            continue;
+        }
+        if(splitBy == SplitBy::File) {
+            documents[files[i]].lines = std::move(lines);
+            continue;
+        }
+        const auto& sections = buffer.sections();
+        if(sections.empty()) {
+            add(std::string(), lines.begin(), lines.end());
+            continue;
+        }
+        for(auto s = 0U; s < sections.size(); ++s) {
+            const auto& [first, title] = sections[s];
+            const auto last = s + 1 < sections.size() ? sections[s + 1].first : lines.size();
+            add(title, lines.begin() + first, lines.begin() + last);
+        }
+    }
+
+    std::vector<std::string> index;
+    if(!outside.empty())
+        index.emplace_back();
+    for(const auto& document : documents)
+        index.push_back("* [" + htmlEscaped(document.title) + "](" + document.name + ")");
+
+    std::atomic<bool> failed{false};
+    const auto write = [&directory, &failed](const std::string& name, const auto& lines, const std::vector<std::string>& tail) {
+        const auto path = (std::filesystem::path(directory) / name).string();
+        auto writer = OutputWriter::replace(path);
+        if(!writer) {
+            std::cerr << "Cannot open output:" << path << std::endl;
+            failed = true;
+            return;
+        }
+        for(const auto& line : lines)
+            writer->writeLine(line);
+        for(const auto& line : tail)
+            writer->writeLine(line);
+        writer->writeLine(Footer);
+        if(!writer->close())
+            failed = true;
+    };
+    parallelFor(documents.size() + 1, std::max(1U, std::thread::hardware_concurrency()), [&](std::size_t i) {
+        if(i == documents.size())
+            write("index.md", outside, index);
+        else
+            write(documents[i].name, documents[i].lines, {});
+    });
+    return failed ? -1 : 0;
 }
 
 void MarkdownMaker::setStyle(const std::string& name, const std::string& style) {
-    m_styles[name] = style;
+    m_styles.insert_or_assign(name, StyleTemplate(style));
 }
 
-std::string MarkdownMaker::style(const std::string& name) const {
+const StyleTemplate& MarkdownMaker::style(std::string_view name) const {
     const auto it = m_styles.find(name);
     if(it == m_styles.end()) {
-        return DefaultStyle;
+        return defaultStyle();
     } else {
         return it->second;
     }
@@ -435,36 +1995,32 @@ bool MarkdownMaker::hasOutput() const {
 }
 
 bool MarkdownMaker::hasInput() const {
-    return !m_content.empty();
+    return !m_files.empty();
 }
 
 void MarkdownMaker::setOutput(const std::string& out) {
-    if(out.empty()) {
-        appendLineArray.push_back( [](std::string append) {
-            append = replace(static_cast<const std::string>(append), R"(\\n)", "") + "\n";
-            replace(append, R"(\\(.))", "$1");
-            std::cout << append;
+    std::shared_ptr<OutputWriter> writer = out.empty() ? OutputWriter::open(out) : OutputWriter::replace(out);
+    if(writer) {
+        m_outputs.push_back(writer);
+        appendLineArray.push_back([writer](std::string_view append) {
+            writer->writeLine(append);
         });
-    } else {
-    auto f = std::make_shared<std::ofstream>(out);
-    if(f->is_open()) {
-        appendLineArray.push_back([f](std::string append) {
-            append = replace(static_cast<const std::string>(append), R"(\\n)", "") + "\n";
-            replace(append, R"(\\(.))", "$1");
-            *f << append;
-        });
-        contentChangedArray.push_back([f]() {
-            std::flush(*f);
+        contentChangedArray.push_back([writer]() {
+            writer->flush();
         });
-
-        m_hasOutput = true;
-
-        } else {
-            std::cerr << "Cannot open output:" << out << std::endl;
-        }
+        m_hasOutput = !out.empty();
+    } else {
+        std::cerr << "Cannot open output:" << out << std::endl;
     }
 }
 
+bool MarkdownMaker::closeOutput() {
+    // every writer is closed, also after one has failed
+    bool ok = true;
+    for(const auto& writer : m_outputs)
+        ok = writer->close() && ok;
+    return ok;
+}
 
 std::string absoluteFilePath(const std::string& rpath) {
 #ifndef WINDOWS_OS
@@ -484,21 +2040,4 @@ std::string absoluteFilePath(const std::string& rpath) {
 #endif
 }
 
-/*
-void MarkdownMaker::setSourceFiles(const std::vector<std::string>& files) {
-    m_content.clear();
-    for(const auto& f : files){
-        addSourceFile(f.toLocalFile());
-    }
-}*/
-/*
-void MarkdownMaker::setOutput(const std::string& file) {
-    if(!m_hasOutput) {
-        doCopy(file);
-    } else {
-            std::cerr << "output already set";
-        }
-}
-*/
-
 
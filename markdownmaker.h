@@ -1,7 +1,11 @@
 #ifndef MARKUPMAKER_H
 #define MARKUPMAKER_H
 
+#include "textarena.h"
+#include "symbolindex.h"
+#include "declarationmatcher.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <unordered_map>
@@ -9,6 +13,8 @@
 #include <stack>
 #include <functional>
 #include <optional>
+#include <memory>
+#include <mutex>
 
 /**
   * ![wqe](https://avatars1.githubusercontent.com/u/7837709?s=400&v=4)
@@ -24,14 +30,71 @@
   * Also, unlike those other generators, MarkdownMaker just generates markdown.
   *
   * #### Command line
-  * @raw `mdmaker <-q> <-o OUTFILE> <INFILES>`
+  * @raw `mdmaker <-q> <-j JOBS> <--watch> <--cache DIR> <--stats> <--trace TRACEFILE> <--index INDEXFILE> <--include GLOB> <--exclude GLOB> <--split DIR> <--split-by file|namespace> <--escape-md> <-MD> <-MF DEPFILE> <-o OUTFILE> <INFILES>`
+  * @raw `mdmaker --serve <--socket SOCKET>`, `mdmaker --manifest MANIFEST`, `mdmaker --client SOCKET <-j JOBS> <--include GLOB> <--exclude GLOB> <-MD> <-MF DEPFILE> -o OUTFILE <INFILES>`
   * @eol
   * * **mdmaker** Since the executable may have been wrapped into bundle, the actual callable name may vary.
   * * -q , Quiet, no UI, suitable for toolchains.
+  * * -j JOBS, Parse source files using JOBS threads, 0 uses all cores. The output is identical to
+  * a single threaded run: files are completed in input order and @style changes affect the
+  * file that sets them and the files after it. A source file larger than 512 kB is parsed in parts
+  * by several threads as well.
+  * * --watch, Keep running and regenerate the output when any of the INFILES changes. Only
+  * the changed files are parsed again, a removed file is left out until it is there again. Requires -o,
+  * cannot be used with --cache, --stats or --trace.
+  * * --cache DIR, Store rendered source files in DIR and reuse them when neither the file nor the
+  * styles in effect have changed. The directory can be shared between concurrent runs. Files
+  * using @date are always generated. A directory grown over 256 MB is trimmed, the least recently
+  * used files first.
+  * * --stats, Print per file figures to stderr: bytes, lines, lines in documentation blocks,
+  * buffered records, links, peak buffered bytes and the time spent parsing, completing and writing.
+  * * --trace TRACEFILE, Write Chrome trace events (chrome://tracing or Perfetto) of reading, parsing,
+  * completing and writing each file to TRACEFILE.
+  * * --index INDEXFILE, Keep the table of contents links of all INFILES in INDEXFILE for @{x40}globaltoc.
+  * Only the files changed since the previous run are indexed again.
+  * * --split DIR, Write a document per input file to DIR instead of a single output, all parsed once.
+  * DIR/index.md links the documents and holds the markdown files and any content not in a document.
+  * * --split-by file|namespace, With --split, a document per input file (default) or per top level
+  * @{x40}namespace, content of the same namespace in several files is joined.
+  * * --escape-md, HTML escape the markdown files of INFILES, by default they are copied as they are.
+  * * -MD, Write a make rule of OUTPUT and all the files read to make it, named as OUTPUT with a .d extension.
+  * Requires -o.
+  * * -MF DEPFILE, As -MD but write the rule to DEPFILE.
   * * -o OUTPUT, Write output to given file, if not given, Save as dialog is shown upon exit. If OUTPUT
-  * is *null* nothing is written and no dialog is shown.
+  * is *null* nothing is written and no dialog is shown. OUTPUT is left untouched if its content
+  * does not change, with Ninja use `restat = 1`.
+  * * --include GLOB, Take only the files matching GLOB from the INFILES directories, can be given several times.
+  * By default the C and C++ sources and headers and the markdown files are taken.
+  * * --exclude GLOB, Skip the files and directories matching GLOB in the INFILES directories, can be given
+  * several times. In a GLOB `*` matches within a directory, `**` across directories and `?` a single
+  * character. A GLOB without `/` is matched to the name, otherwise to the path in the directory.
   * * INFILES, One or more files that are scanned for markdown annotations. Multiple files are joined
-  * as a single output in input order. If input is a markdown file (*.md), that is added as-is.
+  * as a single output in input order. If input is a markdown file (*.md), that is added as-is, the
+  * file is copied by the kernel where possible.
+  * A directory is walked recursively and its files are taken in the order of their paths.
+  * @raw &#x40;LISTFILE reads the INFILES from LISTFILE, one per line, lines starting with # are comments.
+  * @eol
+  * Files found in the directories or listed in LISTFILE are skipped if they contain no documentation.
+  * * --serve, Run the generation jobs read from stdin, or from the connections to SOCKET with --socket,
+  * concurrently. The rendered files are kept in memory, so the following jobs only render the changed files.
+  * * --client SOCKET, Run the command line as a job of the server listening SOCKET.
+  * * --manifest MANIFEST, Run the jobs of MANIFEST, a job per line as read by --serve, concurrently. Each
+  * source file is parsed once for all the jobs and completed with the styles of each job. The errors are
+  * printed with their line in MANIFEST.
+  *
+  * #### Server
+  * @raw A job is a line of JSON, e.g. `{"id": 1, "inputs": ["include", "README.md"], "output": "api.md", "depfile": "api.d"}`.
+  * @raw The optional fields are "id", "directory" of the relative paths, "depfile", "styles" as an object of
+  * @raw style names and styles, "include", "exclude" and "jobs". A response line `{"id": 1, "status": 0, "milliseconds": 2.1}`
+  * @raw is written when the job is done, it has an "error" if the status is not 0.
+  * @eol
+  *
+  * #### Library
+  * The libmdmaker library generates markdown in other applications. MarkdownStream (markdownstream.h)
+  * takes a source in pieces of any size and passes the markdown on as soon as it is known, keeping only
+  * the current section and the table of contents entries in memory. The stream writes the document
+  * in the source order, whereas mdmaker writes the content of each scope together, and the markdown
+  * after a @{x40}toc is held until the stream is closed.
   *
   *
   * ### Annotations
@@ -45,6 +108,8 @@
   * #### Tokens
   * @raw + __&#x40;toc__, generates table of contents. Items are pointing to &#x40;namespace, &#x40;class and &#x40;function tokens in this document.
   * @eol
+  * @raw + __&#x40;globaltoc__, generates table of contents of all the input files, requires --index.
+  * @eol
   * @raw + __&#x40;scope__, starts a generic scope. Scopes are used to divide markdown content.
   * @eol
   * @raw + __&#x40;scopeend__, ends any scope (i.e. also namespace and class scope)
@@ -53,7 +118,7 @@
   * @eol
   * @raw + __&#x40;class NAME__, generates a class header and starts a scope.
   * @eol
-  * @raw + __&#x40;function NAME__, just name, no return value or parameters, , generates a function header. The actual function name string is generated from the function declaration that is expected to found immediately after this markdown section.
+  * @raw + __&#x40;function NAME__, just name, no return value or parameters, , generates a function header. The actual function name string is generated from the function declaration that is expected to found immediately after this markdown section. The parameter list of the declaration may continue on the following lines.
   * @eol
   * @raw + __&#x40;templateparam NAME description__, generates a template parameter header.
   * @eol
@@ -124,84 +189,326 @@ void tie(const ParamList& list, Args& ...args) {
   * , Axq is also used for implementation of this utility.
   */
 
+class FragmentCache;
+class PipelineStats;
+class Tracer;
+class BufferedContent;
+class OutputWriter;
+struct FileStats;
+
+/*
+ * Header style compiled when it is set: the literal text around the %1 placeholders
+ */
+class StyleTemplate {
+public:
+    explicit StyleTemplate(std::string_view style);
+    /* The style as it was given */
+    std::string_view source() const {return std::string_view(m_text).substr(0, m_text.size() - 1);}
+    /* Appends the header line of the value */
+    void render(std::string& out, std::string_view value) const;
+private:
+    std::string m_text;                      // style and a trailing space
+    std::vector<std::size_t> m_placeholders; // positions of %1 in m_text
+};
+
+using StyleMap = std::map<std::string, StyleTemplate, std::less<>>;
+
+/* The built-in styles */
+StyleMap defaultStyles();
+/* The style of the names without a style of their own */
+const StyleTemplate& defaultStyle();
+
 class Styles {
 public:
     virtual void setStyle(const std::string& name, const std::string& style) = 0;
-    virtual std::string style(const std::string& name) const = 0;
+    /* The style of the name, valid until the styles are changed */
+    virtual const StyleTemplate& style(std::string_view name) const = 0;
     virtual ~Styles() = default;
 };
 
 
 class ContentManager : public Styles {
   public:
-    void appendLine(const std::string& line) {std::for_each(appendLineArray.begin(), appendLineArray.end(), [&line](const auto& f){f(line);});}
-    std::vector<std::function<void (const std::string& line)>> appendLineArray;
+    using Sink = std::function<void (std::string_view line)>;
+    /* Sink that collects the output lines (without newline) of the given source and passes them to the output */
+    virtual Sink sink(const std::string& sourceName) = 0;
+    /* Links of all the sources for @globaltoc, null if there is no index */
+    virtual const SymbolIndex* symbolIndex() const {return nullptr;}
+    /* The following lines of a completed source belong to the top level @namespace, empty if none */
+    virtual void beginSection(std::string_view /*name*/) {}
+    /* Error and other messages of the sources, written to stderr */
+    virtual void message(std::string_view text);
+    /* The anchor of the source as written in the output, another one if an earlier source has the same anchor */
+    virtual std::string_view anchor(const std::string& /*sourceName*/, std::string_view anchor) const {return anchor;}
+    /* Appends the target of a link to the anchor of the target source, written in the top level namespace of the source */
+    virtual void appendLink(std::string& out, const std::string& /*sourceName*/, std::string_view /*section*/,
+                            const std::string& targetSource, std::string_view anchor) const {
+        out += '#';
+        out += this->anchor(targetSource, anchor);
+    }
+    void appendLine(std::string_view line) {std::for_each(appendLineArray.begin(), appendLineArray.end(), [&line](const auto& f){f(line);});}
+    std::vector<std::function<void (std::string_view line)>> appendLineArray;
+};
+
+/*
+ * Anchors of the headers of a document. A repeated anchor gets a number, as GitHub
+ * numbers the same headers: name, name-1, name-2...
+ */
+class Anchors {
+public:
+    /* Makes the slug an anchor that is not used yet and adds it */
+    void add(std::string& slug);
+    void clear() {m_anchors.clear();}
+private:
+    std::unordered_map<std::string, unsigned> m_anchors; // and the count of the later same anchors
 };
 
 class SourceParser  {
     enum class State {Out, In, Example1, Example2};
-    enum class Cmd {Add, Toc, Header};
+    enum class Cmd {Add, Toc, GlobalToc, Header};
     struct Link {
-        std::string name;
-        std::string uri;
+        std::string_view name;
+        std::string_view uri;
         int line;
+        std::string_view anchor;
     };
 public:
+    /* The texts refer to the arena of the parser */
     struct Content {
         Cmd cmd;
-        std::string name;
-        std::string value;
-        std::string  uri;
+        std::string_view name;
+        std::string_view value;
+        std::string_view uri;
+    };
+    struct Scope {
+        std::string_view name;
+        std::string_view path;      // names from the nearest _root, joined with ::
+        std::string_view qualified; // path without the trailing unnamed scopes
+        std::string_view section;   // the top level namespace
+        std::vector<Content> content;
     };
 public:
-    SourceParser(const std::string& sourceName, ContentManager& styles);
+    /*
+     * A streaming parser writes its output in document order as soon as it is known: at
+     * each scope boundary, unless a @toc or an unresolved @function is pending.
+     * Otherwise the content of each scope is written together when completed.
+     */
+    SourceParser(const std::string& sourceName, ContentManager& styles, bool streaming = false);
     ~SourceParser();
-    bool parseLine(const std::string& line);
+    /*
+     * Parser of a part of a source that starts at the given line, e.g. in another thread.
+     * Its changes of the structure are deferred until the part is appended.
+     */
+    static std::unique_ptr<SourceParser> part(const std::string& sourceName, ContentManager& styles, int line);
+    /*
+     * Parser of the parsed source that completes it to the given content manager, its messages
+     * tell the name of the source as given here. The texts are kept by parsed, that can be
+     * completed by several parsers concurrently.
+     */
+    SourceParser(const SourceParser& parsed, ContentManager& styles, const std::string& sourceName);
+    /*
+     * Parts of the text to be parsed separately, each of about the size and starting
+     * at the line of a comment start
+     */
+    static std::vector<std::string_view> split(std::string_view text, std::size_t size);
+    /*
+     * Continues with the parsed part of the text as if the text was parsed. The part is
+     * parsed again if the source is not outside of any documentation where it starts.
+     */
+    bool append(SourceParser& part, std::string_view text);
+    /* Parse a single line, given without its line terminator */
+    bool parseLine(std::string_view line);
+    /* Parse a whole source, code between the documentation blocks is skipped without splitting it to lines */
+    bool parse(std::string_view text);
     void complete();
-    void appendLine(const std::string& str) {m_contentManager.appendLine(str);}
+    void appendLine(std::string_view str) {m_sink(str);}
+    /* True if the content depends on the generation time */
+    bool isDated() const {return m_dated;}
+    /* True if the content depends on the other sources */
+    bool hasGlobalToc() const {return m_globalToc;}
+    /* The links of the source for the symbol index */
+    std::vector<SymbolIndex::Symbol> symbols() const;
+    /* The slugs of the headers in the order their anchors were made, i.e. the anchors without numbers */
+    const std::vector<std::string_view>& anchorSlugs() const {return m_anchorSlugs;}
+    /* The top level namespaces in the order the scopes are completed, a namespace is repeated when it is entered again */
+    std::vector<std::string_view> sections() const;
+    /* The anchor and the top level namespace of each header in the order they are completed */
+    std::vector<std::pair<std::string_view, std::string_view>> anchorSections() const;
+    /* Fills the parse figures of the stats */
+    void collectStats(FileStats& stats) const;
 private:
     bool fail(const std::string& message, int line) const;
+    void openScope(std::string_view name, bool isNamespace);
+    void closeScope();
+    /* A change of the structure of the source, deferred by the parser of a part */
+    struct Action {
+        enum class Kind {Open, OpenNamespace, Close, Add, Link, Header, Function, Found, Style, Error, Message, Stop};
+        Kind kind;
+        Content content;
+        int line;
+    };
+    void perform(const Action& action);
+    void add(Cmd cmd, std::string_view name, std::string_view value, std::string_view uri = {}) {
+        if(m_deferred)
+            m_actions.push_back({Action::Kind::Add, {cmd, name, value, uri}, m_line});
+        else
+            m_current->push_back({cmd, name, value, uri});
+    }
+    void addLink(std::string_view name);
+    void addHeader(std::string_view name, std::string_view value);
+    void addFunction(std::string_view name, std::string_view value);
+    void resolveFunction(std::string_view value);
+    void setStyle(std::string_view value);
+    Content& pendingFunction() {
+        if(m_deferred)
+            return m_actions[m_briefName->second].content;
+        return (m_streaming ? m_section : m_scopes[m_briefName->first].content)[m_briefName->second];
+    }
+    void appendText();
+    void render(const Content& record);
+    /* The links are the ones of the target source */
+    void renderToc(const std::vector<Link>& links, const std::string& targetSource);
+    /* The anchor of a header of the text, unique in the source */
+    std::string_view makeAnchor(std::string_view text);
+    /* Writes the pending section of a streaming parser */
+    void flush(bool all);
+    /* Storage of the text of a record, that is released when written */
+    std::string_view recordText(std::string_view text) {return (m_streaming ? m_sectionArena : m_arena).add(text);}
 private:
     const std::string m_sourceName;
     ContentManager& m_contentManager;
+    const ContentManager::Sink m_sink;
     State m_state = State::Out;
-    std::map<std::string, std::vector<Content>> m_content;
+    TextArena m_arena;
+    std::vector<Scope> m_scopes;            // in the order of opening, the first is the root
+    std::vector<std::size_t> m_scopeStack;
+    std::vector<Content>* m_current;        // content of the innermost open scope
     std::vector<Link> m_links;
-    std::stack<std::string> m_scopeStack;
-    std::vector<std::string> m_scopes;
-    std::optional<std::pair<std::string, unsigned>> m_briefName;
+    Anchors m_anchors;
+    std::vector<std::string_view> m_anchorSlugs; // of the anchors made, in order
+    std::string_view m_renderSection;       // top level namespace of the records being completed
+    std::string m_slug;
+    std::optional<std::pair<std::size_t, std::size_t>> m_briefName;
+    DeclarationMatcher m_declaration;       // of the pending @function
+    std::string m_text;                     // reused buffer for a transformed or rendered line
+    const bool m_streaming;
+    std::vector<Content> m_section;         // records not yet written by a streaming parser
+    TextArena m_sectionArena;
+    bool m_hold = false;                    // a streaming parser waits for all the links of a @toc
+    bool m_deferred = false;                // the parser of a part
+    std::vector<Action> m_actions;          // of a part, performed when appended
+    std::vector<TextArena> m_partArenas;    // texts of the appended parts
     int m_line = 0;
+    int m_docLines = 0;
+    bool m_dated = false;
+    bool m_globalToc = false;
 };
 
 
+/*
+ * Sources parsed once for all the generations that share the table, e.g. the jobs of
+ * a manifest, each generation completes them with its own styles. The files are
+ * expected not to change while the table is used.
+ */
+class SourceTable {
+public:
+    struct Source;
+    SourceTable();
+    ~SourceTable();
+    /*
+     * The source parsed by the first caller, null if the file cannot be read. The files are
+     * the same by their absolute path, whatever name each caller gives.
+     */
+    std::shared_ptr<const Source> source(const std::string& fileName);
+private:
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<Source>> m_sources;
+};
+
 class MarkdownMaker : public ContentManager {
 public:
     explicit MarkdownMaker();
-    void addMarkupFile(const std::string& mdFile);
-    void addSourceFile(const std::string& sourceFile);
-//    void setOutput(const std::string& out);
+    ~MarkdownMaker();
+    /* The name is rendered, the file is opened from the path if given, e.g. when relative to another directory */
+    void addMarkupFile(const std::string& mdFile, const std::string& path = {});
+    void addSourceFile(const std::string& sourceFile, const std::string& path = {});
     void addFooter();
     bool hasOutput() const;
     bool hasInput() const;
- //   void setSourceFiles(const std::vector<std::string>& files);
     void setOutput(const std::string& file);
+    /* Closes the output files, they are replaced only if their content has changed */
+    bool closeOutput();
 
-//    void appendLine(const std::string& line);
-//    void allMade();
     void contentChanged() {std::for_each(contentChangedArray.begin(), contentChangedArray.end(), [](const auto& f){f();});}
- //   void showFileOpen();
-  //  void doCopy(const std::string& target);
-    void execute();
+    void setJobs(unsigned jobs);
+    void setCacheDirectory(const std::string& directory);
+    /* Uses a cache shared with other generations, its hits are not reported */
+    void setCache(std::shared_ptr<FragmentCache> cache);
+    /* Takes the parsed sources from a table shared with other generations */
+    void setSources(std::shared_ptr<SourceTable> sources);
+    /* Report per file statistics to stderr after execute */
+    void setStats(bool stats);
+    /* Write Chrome trace events of execute to the file */
+    void setTrace(const std::string& traceFile);
+    /* Keep the links of the sources in the index file for @globaltoc */
+    void setIndex(const std::string& indexFile);
+    /* HTML escape the markup files, otherwise they are copied as they are */
+    void setEscapeMarkup(bool escape) {m_escapeMarkup = escape;}
+    /* Returns false if the index or the trace could not be saved */
+    bool execute();
+    /* Regenerates the output file whenever the inputs change, returns only on error */
+    int watch(const std::string& output);
+    enum class SplitBy {File, Namespace};
+    /* Writes a document of each input file or top level @namespace and an index.md to the directory */
+    int split(const std::string& directory, SplitBy splitBy);
 public:
     std::string content() const;
+    Sink sink(const std::string& sourceName);
     void setStyle(const std::string& name, const std::string& style);
-    std::string style(const std::string& name) const;
+    const StyleTemplate& style(std::string_view name) const;
+    const SymbolIndex* symbolIndex() const {return m_index.get();}
+    std::string_view anchor(const std::string& sourceName, std::string_view anchor) const override;
+    void appendLink(std::string& out, const std::string& sourceName, std::string_view section,
+                    const std::string& targetSource, std::string_view anchor) const override;
 private:
-    std::vector<std::pair<std::string, std::function<void()>>> m_files;
+    void sourceFileFailed(const std::string& sourceFile);
+    std::string stylesKey() const;
+    using Buffers = std::vector<std::unique_ptr<BufferedContent>>;
+    /* Parses the source files of the indices to new buffers, when executing with the cache, --stats and --trace */
+    void parseFiles(Buffers& buffers, const std::vector<std::size_t>& files, bool executing);
+    /* Updates the index, if any, with the parsed buffers, returns false if it could not be saved */
+    bool updateIndex(const Buffers& buffers);
+    /* Numbers the anchors of the source past the ones of the sources before, returns the renamed ones */
+    std::unordered_map<std::string, std::string> claimAnchors(const std::string& sourceName, const std::vector<std::string_view>& slugs);
+    /* The split document of the lines of the source in the top level namespace */
+    const std::string& documentOf(const std::string& sourceName, std::string_view section) const;
+private:
+    struct InputFile {
+        std::string name;
+        std::string path;   // to open the file from
+        std::function<void()> execute;
+        bool source;
+    };
+    std::vector<InputFile> m_files;
     std::unordered_map<std::string, std::string> m_content;
-    std::unordered_map<std::string, std::string> m_styles;
+    StyleMap m_styles;
+    StyleMap m_defaultStyles;
     int m_completed = 0;
+    unsigned m_jobs = 1;
+    std::shared_ptr<FragmentCache> m_cache;
+    std::shared_ptr<SourceTable> m_sources;
+    bool m_reportCache = false;
+    bool m_escapeMarkup = false;
+    std::unique_ptr<PipelineStats> m_stats;
+    std::unique_ptr<Tracer> m_tracer;
+    std::unique_ptr<SymbolIndex> m_index;
+    Anchors m_anchors;                      // of the whole output
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> m_renamedAnchors; // of each source
+    std::optional<SplitBy> m_splitBy;       // of the split being written
+    std::unordered_map<std::string, std::string> m_documents; // of each source or top level namespace, as split by
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> m_anchorSections; // namespaces of the anchors of each source
     bool m_hasOutput = false;
+    std::vector<std::shared_ptr<OutputWriter>> m_outputs;
     std::vector<std::function<void ()>> contentChangedArray;
 };
 
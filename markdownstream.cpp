@@ -0,0 +1,100 @@
+#include "markdownstream.h"
+#include "markdownmaker.h"
+
+/*
+ * Styles of the stream and its markdown not yet delivered
+ */
+class MarkdownStream::Content : public ContentManager {
+public:
+    Sink sink(const std::string&) override {
+        return [this](std::string_view line) {
+            markdown += line;
+            markdown += '\n';
+        };
+    }
+    void setStyle(const std::string& name, const std::string& style) override {
+        m_styles.insert_or_assign(name, StyleTemplate(style));
+    }
+    const StyleTemplate& style(std::string_view name) const override {
+        const auto it = m_styles.find(name);
+        return it == m_styles.end() ? defaultStyle() : it->second;
+    }
+    std::string markdown;
+private:
+    StyleMap m_styles = defaultStyles();
+};
+
+MarkdownStream::MarkdownStream(const std::string& sourceName, Output output) :
+    m_content(std::make_unique<Content>()),
+    m_parser(std::make_unique<SourceParser>(sourceName, *m_content, true)),
+    m_output(std::move(output)) {
+}
+
+MarkdownStream::~MarkdownStream() {
+}
+
+void MarkdownStream::setStyle(const std::string& name, const std::string& style) {
+    m_content->setStyle(name, style);
+}
+
+void MarkdownStream::parse(std::string_view lines) {
+    if(!m_failed)
+        m_failed = !m_parser->parse(lines);
+}
+
+/*
+ * Complete lines are parsed as they are written, the last partial line waits for its end
+ */
+void MarkdownStream::write(std::string_view data) {
+    if(m_closed)
+        return;
+    if(!m_partial.empty()) {
+        const auto end = data.find('\n');
+        if(end == std::string_view::npos) {
+            m_partial.append(data);
+            return;
+        }
+        m_partial.append(data.substr(0, end + 1));
+        parse(m_partial);
+        m_partial.clear();
+        data.remove_prefix(end + 1);
+    }
+    const auto last = data.rfind('\n');
+    if(last != std::string_view::npos) {
+        parse(data.substr(0, last + 1));
+        data.remove_prefix(last + 1);
+    }
+    m_partial.assign(data);
+    deliver();
+}
+
+void MarkdownStream::close() {
+    if(m_closed)
+        return;
+    if(!m_partial.empty())
+        parse(m_partial);
+    m_partial.clear();
+    m_parser->complete();
+    m_closed = true;
+    deliver();
+}
+
+std::string MarkdownStream::read() {
+    std::string markdown;
+    markdown.swap(m_content->markdown);
+    return markdown;
+}
+
+void MarkdownStream::deliver() {
+    if(m_output && !m_content->markdown.empty()) {
+        m_output(m_content->markdown);
+        m_content->markdown.clear();
+    }
+}
+
+std::string renderMarkdown(std::string_view source, const std::string& sourceName) {
+    MarkdownStream stream(sourceName);
+    stream.write(source);
+    stream.close();
+    return stream.read();
+}
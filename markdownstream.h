@@ -0,0 +1,59 @@
+#ifndef MARKDOWNSTREAM_H
+#define MARKDOWNSTREAM_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+
+class SourceParser;
+
+/*
+ * Generates the markdown of a single source incrementally, for embedding MarkdownMaker
+ * into other applications (link with libmdmaker).
+ *
+ * The source is written in pieces of any size and the markdown is produced as soon as it
+ * is known: either passed to the output function as chunks (push) or collected to be
+ * taken with read (pull). Only the current section of the source and the table of contents
+ * entries are kept in memory.
+ *
+ * Unlike mdmaker, which writes the content of each scope together, the stream follows
+ * the document order and a header uses the styles set before its section is written.
+ * A @toc needs the whole source, therefore the rest of the markdown after it is held
+ * until close.
+ */
+class MarkdownStream {
+public:
+    using Output = std::function<void (std::string_view markdown)>;
+    /* Without an output function the markdown is collected for read */
+    explicit MarkdownStream(const std::string& sourceName, Output output = nullptr);
+    ~MarkdownStream();
+    MarkdownStream(const MarkdownStream&) = delete;
+    MarkdownStream& operator=(const MarkdownStream&) = delete;
+    /* Style used unless the source sets its own, see @style */
+    void setStyle(const std::string& name, const std::string& style);
+    void write(std::string_view data);
+    /* End of the source, the rest of the markdown is produced */
+    void close();
+    /* Markdown produced since the previous read, empty if none */
+    std::string read();
+    bool isClosed() const {return m_closed;}
+    /* False if the source could not be parsed, the markdown ends to the error */
+    bool isValid() const {return !m_failed;}
+private:
+    void parse(std::string_view lines);
+    void deliver();
+private:
+    class Content;
+    const std::unique_ptr<Content> m_content;
+    const std::unique_ptr<SourceParser> m_parser;
+    const Output m_output;
+    std::string m_partial; // the last line until its end is written
+    bool m_closed = false;
+    bool m_failed = false;
+};
+
+/* The markdown of the whole source */
+std::string renderMarkdown(std::string_view source, const std::string& sourceName = "");
+
+#endif // MARKDOWNSTREAM_H
@@ -0,0 +1,365 @@
+#include "outputwriter.h"
+#include "sourcereader.h"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#ifndef WINDOWS_OS
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#else
+#include <io.h>
+#include <fcntl.h>
+#include <process.h>
+#define getpid _getpid
+#endif
+
+constexpr std::size_t ChunkSize = 64 * 1024;
+constexpr std::size_t MaxChunks = 16;
+
+static int openFile(const std::string& fileName, bool text = true) {
+#ifndef WINDOWS_OS
+    (void) text;
+    return ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#else
+    return ::_open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | (text ? _O_TEXT : _O_BINARY), 0666);
+#endif
+}
+
+std::string temporaryName(const std::string& fileName) {
+    static std::atomic<unsigned> temporaries{0};
+    std::ostringstream name;
+    name << fileName << ".tmp-" << getpid() << '-' << std::this_thread::get_id() << '-' << temporaries++;
+    return name.str();
+}
+
+/*
+ * The file that a (chain of) symbolic link(s) points to, as that is the one to replace,
+ * otherwise the name itself
+ */
+static std::string resolveLinks(const std::string& fileName) {
+    std::filesystem::path path(fileName);
+    std::error_code ec;
+    for(auto links = 0; links < 40 && std::filesystem::is_symlink(path, ec); ++links) {
+        const auto target = std::filesystem::read_symlink(path, ec);
+        if(ec)
+            break;
+        path = target.is_absolute() ? target : path.parent_path() / target;
+    }
+    return path.string();
+}
+
+/*
+ * Gives the file the permissions of the file it replaces, if there is one
+ */
+static void copyMode(int fd, const std::string& fileName) {
+#ifndef WINDOWS_OS
+    struct stat st;
+    if(::stat(fileName.c_str(), &st) == 0)
+        (void) ::fchmod(fd, st.st_mode & 07777);
+#else
+    (void) fd;
+    (void) fileName;
+#endif
+}
+
+static void closeFile(int fd) {
+#ifndef WINDOWS_OS
+    ::close(fd);
+#else
+    ::_close(fd);
+#endif
+}
+
+/*
+ * Renames the written temporary over the file, the temporary is removed if it cannot be
+ */
+static bool renameOver(const std::string& temporary, const std::string& fileName) {
+    std::error_code ec;
+    std::filesystem::rename(temporary, fileName, ec);
+    if(!ec)
+        return true;
+    std::filesystem::remove(temporary, ec);
+    return false;
+}
+
+static bool writeData(int fd, std::string_view data) {
+    while(!data.empty()) {
+#ifndef WINDOWS_OS
+        const auto written = ::write(fd, data.data(), data.size());
+        if(written < 0 && errno == EINTR)
+            continue;
+#else
+        const auto written = ::_write(fd, data.data(), static_cast<unsigned>(data.size()));
+#endif
+        if(written < 0)
+            return false;
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+    return true;
+}
+
+std::unique_ptr<OutputWriter> OutputWriter::open(const std::string& fileName) {
+    if(fileName.empty())
+        return std::unique_ptr<OutputWriter>(new OutputWriter(1));
+    const auto fd = openFile(fileName);
+    if(fd < 0)
+        return nullptr;
+    return std::unique_ptr<OutputWriter>(new OutputWriter(fd));
+}
+
+/*
+ * Flushed chunks are compared to the previous file as long as they are the same,
+ * the temporary file is written only from the first difference on.
+ */
+std::unique_ptr<OutputWriter> OutputWriter::replace(const std::string& fileName) {
+    if(fileName.empty())
+        return nullptr;
+    const auto target = resolveLinks(fileName);
+    const auto directory = std::filesystem::path(target).parent_path();
+    std::error_code ec;
+    if(!std::filesystem::is_directory(directory.empty() ? "." : directory, ec))
+        return nullptr;
+    std::unique_ptr<OutputWriter> writer(new OutputWriter(-1));
+    writer->m_fileName = target;
+    writer->m_previous = std::make_unique<SourceReader>(target);
+    return writer;
+}
+
+OutputWriter::OutputWriter(int fd) : m_fd(fd) {
+    m_chunk.reserve(ChunkSize);
+}
+
+OutputWriter::~OutputWriter() {
+    close();
+}
+
+bool OutputWriter::openTemporary() {
+    m_temporary = temporaryName(m_fileName);
+    m_fd = openFile(m_temporary);
+    if(m_fd >= 0)
+        copyMode(m_fd, m_fileName);
+    if(m_fd < 0 || !writeData(m_fd, m_previous->data().substr(0, m_matched))) {
+        std::cerr << "Cannot write output:" << m_temporary << std::endl;
+        m_ok = false;
+    }
+    return m_ok;
+}
+
+bool OutputWriter::close() {
+    if(m_closed)
+        return m_ok;
+    flush();
+    m_closed = true;
+    if(m_fileName.empty()) {
+        if(m_fd > 2)
+            closeFile(m_fd);
+        return m_ok;
+    }
+    const auto same = m_previous->isOpen() && m_matched == m_previous->data().size();
+    if(m_fd < 0 && m_ok && !same)   // a shorter or a new file
+        openTemporary();
+    m_previous.reset();
+    if(m_fd < 0)
+        return m_ok;
+    closeFile(m_fd);
+    if(!m_ok || !renameOver(m_temporary, m_fileName)) {
+        std::error_code ec;
+        std::filesystem::remove(m_temporary, ec);
+        std::cerr << "Cannot write output:" << m_fileName << std::endl;
+        m_ok = false;
+    }
+    return m_ok;
+}
+
+void OutputWriter::writeLine(std::string_view line) {
+    if(!m_chunk.empty() && m_chunk.size() + line.size() + 1 > ChunkSize)
+        nextChunk();
+    m_chunk.append(line);
+    m_chunk += '\n';
+}
+
+void OutputWriter::write(std::string_view data) {
+    if(!m_chunk.empty() && m_chunk.size() + data.size() > ChunkSize)
+        nextChunk();
+    m_chunk.append(data);
+}
+
+/*
+ * While the output is the same as the previous file the content is only compared, and
+ * from the first difference on it is written as for an ordinary output.
+ */
+void OutputWriter::writeFile(const std::string& fileName, std::string_view content) {
+    flush();
+    if(content.empty() || !m_ok)
+        return;
+    if(!m_fileName.empty() && m_fd < 0) {
+        if(m_previous->data().substr(m_matched, content.size()) == content) {
+            m_matched += content.size();
+            return;
+        }
+        if(!openTemporary())
+            return;
+    }
+    // the rest, e.g. if the file was truncated meanwhile, is written from the content
+    if(!writeData(m_fd, content.substr(copyFile(fileName, content.size())))) {
+        std::cerr << "Cannot write output" << std::endl;
+        m_ok = false;
+    }
+}
+
+/*
+ * Copies the file in the kernel, returns the bytes copied. A file of another size
+ * than expected (i.e. changed since read) is not copied.
+ */
+std::size_t OutputWriter::copyFile(const std::string& fileName, std::size_t size) {
+#ifdef __linux__
+    const auto in = ::open(fileName.c_str(), O_RDONLY);
+    if(in < 0)
+        return 0;
+    struct stat st;
+    if(::fstat(in, &st) != 0 || !S_ISREG(st.st_mode) || static_cast<std::size_t>(st.st_size) != size) {
+        ::close(in);
+        return 0;
+    }
+    loff_t offset = 0;
+    // copy_file_range requires files (of the same file system before Linux 5.3), sendfile takes any output
+    auto copyRange = true;
+    while(offset < static_cast<loff_t>(size)) {
+        const auto left = size - static_cast<std::size_t>(offset);
+        const auto copied = copyRange ? ::copy_file_range(in, &offset, m_fd, nullptr, left, 0)
+                                      : ::sendfile(m_fd, in, &offset, left);
+        if(copied < 0 && errno == EINTR)
+            continue;
+        if(copied < 0 && copyRange && offset == 0) {
+            copyRange = false;
+            continue;
+        }
+        if(copied <= 0)
+            break;
+    }
+    ::close(in);
+    return static_cast<std::size_t>(offset);
+#else
+    (void) fileName;
+    (void) size;
+    return 0;
+#endif
+}
+
+void OutputWriter::nextChunk() {
+    m_chunks.push_back(std::move(m_chunk));
+    m_chunk = std::string();
+    m_chunk.reserve(ChunkSize);
+    if(m_chunks.size() >= MaxChunks)
+        flush();
+}
+
+void OutputWriter::flush() {
+    if(!m_chunk.empty()) {
+        m_chunks.push_back(std::move(m_chunk));
+        m_chunk = std::string();
+        m_chunk.reserve(ChunkSize);
+    }
+    if(m_chunks.empty())
+        return;
+    if(!m_fileName.empty() && m_fd < 0) {
+        const auto previous = m_previous->data();
+        auto same = m_ok;
+        for(auto it = m_chunks.begin(); same && it != m_chunks.end();) {
+            same = previous.substr(m_matched, it->size()) == *it;
+            if(same) {
+                m_matched += it->size();
+                it = m_chunks.erase(it);
+            }
+        }
+        if(!same && m_ok)
+            openTemporary();
+        if(!m_ok)
+            m_chunks.clear();
+        if(m_chunks.empty())
+            return;
+    }
+#ifndef WINDOWS_OS
+    std::vector<iovec> io;
+    for(auto& chunk : m_chunks)
+        io.push_back({chunk.data(), chunk.size()});
+    auto first = io.begin();
+    while(first != io.end()) {
+        const auto written = ::writev(m_fd, &*first, static_cast<int>(io.end() - first));
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            std::cerr << "Cannot write output" << std::endl;
+            m_ok = false;
+            break;
+        }
+        auto left = static_cast<std::size_t>(written);
+        while(first != io.end() && left >= first->iov_len) {
+            left -= first->iov_len;
+            ++first;
+        }
+        if(first != io.end()) {
+            first->iov_base = static_cast<char*>(first->iov_base) + left;
+            first->iov_len -= left;
+        }
+    }
+#else
+    for(const auto& chunk : m_chunks) {
+        if(::_write(m_fd, chunk.data(), static_cast<unsigned>(chunk.size())) < 0) {
+            std::cerr << "Cannot write output" << std::endl;
+            m_ok = false;
+            break;
+        }
+    }
+#endif
+    m_chunks.clear();
+}
+
+bool atomicReplace(const std::string& fileName, std::string_view content) {
+    const auto target = resolveLinks(fileName);
+    const auto temporary = temporaryName(target);
+    const auto fd = openFile(temporary, false);
+    if(fd < 0)
+        return false;
+    copyMode(fd, target);
+    const auto written = writeData(fd, content);
+    closeFile(fd);
+    if(!written) {
+        std::error_code ec;
+        std::filesystem::remove(temporary, ec);
+        return false;
+    }
+    return renameOver(temporary, target);
+}
+
+bool writeDepfile(const std::string& depfile, const std::string& target, const std::vector<std::string>& dependencies) {
+    const auto escaped = [](const std::string& name) {
+        std::string out;
+        for(const auto c : name) {
+            if(c == ' ' || c == '#')
+                out += '\\';
+            else if(c == '$')
+                out += '$';
+            out += c;
+        }
+        return out;
+    };
+    auto writer = OutputWriter::replace(depfile);
+    if(!writer) {
+        std::cerr << "Cannot open output:" << depfile << std::endl;
+        return false;
+    }
+    writer->writeLine(escaped(target) + ":" + (dependencies.empty() ? "" : " \\"));
+    for(auto i = 0U; i < dependencies.size(); ++i)
+        writer->writeLine("  " + escaped(dependencies[i]) + (i + 1 < dependencies.size() ? " \\" : ""));
+    return writer->close();
+}
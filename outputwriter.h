@@ -0,0 +1,72 @@
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+class SourceReader;
+
+/*
+ * Buffered line writer, lines are collected to large chunks that are written
+ * out together (using writev where available).
+ */
+class OutputWriter {
+public:
+    /* Opens the file for writing, an empty name writes to stdout, returns nullptr on failure */
+    static std::unique_ptr<OutputWriter> open(const std::string& fileName);
+    /*
+     * Opens the file for replacing, it is left untouched if the written content is the same,
+     * otherwise the content is written aside to a temporary file of its own in the same directory
+     * and renamed over the file on close. A symbolic link is followed, i.e. the file it points to is
+     * replaced, and the permissions of the replaced file are kept.
+     * Returns nullptr on failure.
+     */
+    static std::unique_ptr<OutputWriter> replace(const std::string& fileName);
+    ~OutputWriter();
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+    /* Appends the line and a newline */
+    void writeLine(std::string_view line);
+    /* Appends the data as it is */
+    void write(std::string_view data);
+    /*
+     * Appends the file, of which the content is given (e.g. mapped by SourceReader). The file is
+     * copied by the kernel where possible (copy_file_range, sendfile), otherwise the content is written.
+     */
+    void writeFile(const std::string& fileName, std::string_view content);
+    void flush();
+    /* Flushes and closes the file, false if it cannot be written */
+    bool close();
+private:
+    explicit OutputWriter(int fd);
+    bool openTemporary();
+    void nextChunk();
+    std::size_t copyFile(const std::string& fileName, std::size_t size);
+private:
+    int m_fd;
+    bool m_ok = true;
+    bool m_closed = false;
+    std::string m_fileName;                 // file to replace, symbolic links resolved
+    std::string m_temporary;                // where the content is written aside
+    std::unique_ptr<SourceReader> m_previous;
+    std::size_t m_matched = 0;              // bytes same as in the previous file
+    std::vector<std::string> m_chunks;
+    std::string m_chunk;
+};
+
+/* Name beside the file that no other writer uses, also in the other processes */
+std::string temporaryName(const std::string& fileName);
+
+/*
+ * Writes the content to a temporary beside the file and renames it over the file, so that the file
+ * is either the previous or the new one for any reader. A symbolic link is followed and the permissions
+ * of the replaced file are kept. False if the file cannot be written, the temporary is then removed.
+ */
+bool atomicReplace(const std::string& fileName, std::string_view content);
+
+/* Writes a make rule of the target and the files it was made of, as a compiler with -MD */
+bool writeDepfile(const std::string& depfile, const std::string& target, const std::vector<std::string>& dependencies);
+
+#endif // OUTPUTWRITER_H
@@ -0,0 +1,25 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Calls f(0...count - 1) using at most jobs threads
+ */
+template <typename F>
+void parallelFor(std::size_t count, unsigned jobs, F&& f) {
+    std::atomic<std::size_t> next{0};
+    const auto work = [count, &next, &f]() {
+        for(auto i = next++; i < count; i = next++)
+            f(i);
+    };
+    std::vector<std::thread> workers;
+    for(auto i = 0U; i < std::min<std::size_t>(jobs, count); ++i)
+        workers.emplace_back(work);
+    std::for_each(workers.begin(), workers.end(), [](auto& t){t.join();});
+}
+
+#endif // PARALLELFOR_H
@@ -0,0 +1,101 @@
+#include "pipelinestats.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+
+void PipelineStats::setFiles(const std::vector<std::string>& names) {
+    m_files.assign(names.size(), FileStats());
+    for(auto i = 0U; i < names.size(); ++i)
+        m_files[i].name = names[i];
+}
+
+void PipelineStats::report(std::ostream& out) const {
+    const auto ms = [](double seconds) {return seconds * 1000.0;};
+    const auto row = [&out, &ms](const FileStats& s) {
+        out << std::setw(12) << s.bytes << std::setw(9) << s.lines << std::setw(10) << s.docLines
+            << std::setw(9) << s.records << std::setw(7) << s.links << std::setw(12) << s.peakBufferedBytes
+            << std::fixed << std::setprecision(2)
+            << std::setw(10) << ms(s.parseSeconds) << std::setw(12) << ms(s.completeSeconds)
+            << std::setw(10) << ms(s.writeSeconds) << "  " << s.name << std::endl;
+    };
+    out << std::setw(12) << "bytes" << std::setw(9) << "lines" << std::setw(10) << "doc-lines"
+        << std::setw(9) << "records" << std::setw(7) << "links" << std::setw(12) << "peak-bytes"
+        << std::setw(10) << "parse-ms" << std::setw(12) << "complete-ms" << std::setw(10) << "write-ms"
+        << "  file" << std::endl;
+    FileStats total;
+    total.name = "total";
+    for(const auto& s : m_files) {
+        row(s);
+        total.bytes += s.bytes;
+        total.lines += s.lines;
+        total.docLines += s.docLines;
+        total.records += s.records;
+        total.links += s.links;
+        total.peakBufferedBytes = std::max(total.peakBufferedBytes, s.peakBufferedBytes);
+        total.parseSeconds += s.parseSeconds;
+        total.completeSeconds += s.completeSeconds;
+        total.writeSeconds += s.writeSeconds;
+    }
+    row(total);
+}
+
+static void appendJsonString(std::string& out, const std::string& s) {
+    out += '"';
+    for(const auto c : s) {
+        switch(c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", c);
+                out += code;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+Tracer::Tracer(const std::string& fileName) : m_fileName(fileName), m_start(Clock::now()) {}
+
+void Tracer::addSpan(const std::string& name, const char* category, const std::string& file,
+                     Clock::time_point start, Clock::time_point end) {
+    const auto us = [](Clock::duration d) {return std::chrono::duration<double, std::micro>(d).count();};
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    const auto thread = m_threads.emplace(std::this_thread::get_id(), static_cast<int>(m_threads.size()) + 1).first->second;
+    m_events.push_back({name, category, file, us(start - m_start), us(end - start), thread});
+}
+
+/*
+ * Complete ("X") events in the Trace Event Format
+ */
+bool Tracer::write() const {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for(auto i = 0U; i < m_events.size(); ++i) {
+        const auto& e = m_events[i];
+        json += i > 0 ? ",\n" : "\n";
+        json += "{\"name\":";
+        appendJsonString(json, e.name);
+        json += ",\"cat\":\"";
+        json += e.category;
+        json += "\",\"ph\":\"X\",\"ts\":" + std::to_string(e.start) + ",\"dur\":" + std::to_string(e.duration)
+                + ",\"pid\":1,\"tid\":" + std::to_string(e.thread) + ",\"args\":{\"file\":";
+        appendJsonString(json, e.file);
+        json += "}}";
+    }
+    json += "\n]}\n";
+    std::ofstream out(m_fileName, std::ios::binary);
+    out << json;
+    if(!out.good()) {
+        std::cerr << "Cannot write trace:" << m_fileName << std::endl;
+        return false;
+    }
+    return true;
+}
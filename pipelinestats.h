@@ -0,0 +1,97 @@
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <ostream>
+
+/*
+ * Figures of a single input file, collected for --stats
+ */
+struct FileStats {
+    std::string name;
+    std::size_t bytes = 0;
+    std::size_t lines = 0;
+    std::size_t docLines = 0;           // lines inside documentation blocks
+    std::size_t records = 0;            // Content records buffered by the parser
+    std::size_t links = 0;
+    std::size_t peakBufferedBytes = 0;  // size of the buffered Content records
+    double parseSeconds = 0;
+    double completeSeconds = 0;
+    double writeSeconds = 0;
+};
+
+/*
+ * Per file statistics of a generation, printed as a table
+ */
+class PipelineStats {
+public:
+    void setFiles(const std::vector<std::string>& names);
+    FileStats& file(std::size_t index) {return m_files[index];}
+    void report(std::ostream& out) const;
+private:
+    std::vector<FileStats> m_files;
+};
+
+/*
+ * Collects Chrome trace events (chrome://tracing, Perfetto) of the
+ * generation and writes them as JSON. Spans can be added from any thread.
+ */
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+    explicit Tracer(const std::string& fileName);
+    void addSpan(const std::string& name, const char* category, const std::string& file,
+                 Clock::time_point start, Clock::time_point end);
+    bool write() const;
+private:
+    struct Event {
+        std::string name;
+        const char* category;
+        std::string file;
+        double start;
+        double duration;
+        int thread;
+    };
+    const std::string m_fileName;
+    const Clock::time_point m_start;
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+    std::unordered_map<std::thread::id, int> m_threads;
+};
+
+/*
+ * Times its scope: the duration is added to seconds and a span is added to the tracer,
+ * each when not null. Without either the clock is not read at all.
+ */
+class Span {
+public:
+    Span(double* seconds, Tracer* tracer, const char* name, const std::string& file) :
+        m_seconds(seconds), m_tracer(tracer), m_name(name), m_file(file) {
+        if(m_seconds || m_tracer)
+            m_start = Tracer::Clock::now();
+    }
+    ~Span() {
+        if(!m_seconds && !m_tracer)
+            return;
+        const auto end = Tracer::Clock::now();
+        if(m_seconds)
+            *m_seconds += std::chrono::duration<double>(end - m_start).count();
+        if(m_tracer)
+            m_tracer->addSpan(m_name, "mdmaker", m_file, m_start, end);
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+private:
+    double* const m_seconds;
+    Tracer* const m_tracer;
+    const char* const m_name;
+    const std::string& m_file;
+    Tracer::Clock::time_point m_start;
+};
+
+#endif // PIPELINESTATS_H
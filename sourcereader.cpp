@@ -0,0 +1,56 @@
+#include "sourcereader.h"
+#include <fstream>
+#include <sstream>
+
+#ifndef WINDOWS_OS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SourceReader::SourceReader(const std::string& fileName) {
+#ifndef WINDOWS_OS
+    const auto fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+        return;
+    struct stat st;
+    if(::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        m_open = true;
+        if(st.st_size > 0) {
+            auto map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if(map != MAP_FAILED) {
+                ::madvise(map, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+                m_data = static_cast<const char*>(map);
+                m_size = static_cast<std::size_t>(st.st_size);
+                m_mapped = true;
+            } else {
+                m_open = false;
+            }
+        }
+    }
+    ::close(fd);
+    if(m_open)
+        return;
+#endif
+    m_open = readStream(fileName);
+}
+
+SourceReader::~SourceReader() {
+#ifndef WINDOWS_OS
+    if(m_mapped)
+        ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+}
+
+bool SourceReader::readStream(const std::string& fileName) {
+    std::ifstream file(fileName);
+    if(!file.is_open())
+        return false;
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    m_buffer = stream.str();
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+}
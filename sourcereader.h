@@ -0,0 +1,45 @@
+#ifndef SOURCEREADER_H
+#define SOURCEREADER_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * Read-only view of an input file. Regular files are memory mapped, other
+ * inputs (e.g. pipes) and platforms without mmap are read into a buffer.
+ */
+class SourceReader {
+public:
+    explicit SourceReader(const std::string& fileName);
+    ~SourceReader();
+    SourceReader(const SourceReader&) = delete;
+    SourceReader& operator=(const SourceReader&) = delete;
+    bool isOpen() const {return m_open;}
+    std::string_view data() const {return {m_data, m_size};}
+    /*
+     * Calls f for each line without its '\n', as std::getline would split them,
+     * stops if f returns false.
+     */
+    template <typename F>
+    bool forEachLine(F&& f) const {
+        std::size_t pos = 0;
+        while(pos < m_size) {
+            const auto end = data().find('\n', pos);
+            const auto last = end == std::string_view::npos ? m_size : end;
+            if(!f(data().substr(pos, last - pos)))
+                return false;
+            pos = last + 1;
+        }
+        return true;
+    }
+private:
+    bool readStream(const std::string& fileName);
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+    bool m_open = false;
+    bool m_mapped = false;
+    std::string m_buffer;
+};
+
+#endif // SOURCEREADER_H
@@ -0,0 +1,165 @@
+#include "symbolindex.h"
+#include "sourcereader.h"
+#include "outputwriter.h"
+#include <filesystem>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+
+constexpr char IndexFormat[] = "mdmaker-index-1";
+
+/*
+ * The file is the format tag, a newline and then unsigned LEB128 numbers and strings
+ * (length and bytes): the count of files, and per file its name, content key, count of
+ * symbols and for each symbol its name, text, anchor and line.
+ */
+namespace {
+class Writer {
+public:
+    Writer& number(std::size_t value) {
+        while(value >= 0x80) {
+            m_data += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        m_data += static_cast<char>(value);
+        return *this;
+    }
+    Writer& string(const std::string& s) {
+        number(s.size());
+        m_data += s;
+        return *this;
+    }
+    const std::string& data() const {return m_data;}
+private:
+    std::string m_data;
+};
+
+class Reader {
+public:
+    explicit Reader(std::string_view data) : m_data(data) {}
+    std::optional<std::size_t> number() {
+        std::size_t value = 0;
+        for(auto shift = 0U; m_pos < m_data.size() && shift < 64; shift += 7) {
+            const auto byte = static_cast<unsigned char>(m_data[m_pos++]);
+            value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+            if(!(byte & 0x80))
+                return value;
+        }
+        return std::nullopt;
+    }
+    std::optional<std::string> string() {
+        const auto size = number();
+        if(!size || *size > m_data.size() - m_pos)
+            return std::nullopt;
+        std::string s(m_data.substr(m_pos, *size));
+        m_pos += *size;
+        return s;
+    }
+    bool atEnd() const {return m_pos == m_data.size();}
+private:
+    const std::string_view m_data;
+    std::size_t m_pos = 0;
+};
+}
+
+SymbolIndex::SymbolIndex(const std::string& fileName) : m_fileName(fileName) {
+    if(!load()) {
+        m_entries.clear();
+        m_positions.clear();
+        ++m_revision; // a new or invalid index is written in any case
+    }
+}
+
+bool SymbolIndex::load() {
+    const SourceReader file(m_fileName);
+    if(!file.isOpen())
+        return false;
+    const std::string_view format(IndexFormat);
+    const auto data = file.data();
+    if(data.substr(0, format.size()) != format || data.size() <= format.size() || data[format.size()] != '\n')
+        return false;
+    Reader reader(data.substr(format.size() + 1));
+    const auto files = reader.number();
+    if(!files)
+        return false;
+    for(auto i = 0U; i < *files; ++i) {
+        Entry entry;
+        const auto name = reader.string();
+        const auto contentKey = reader.string();
+        const auto count = reader.number();
+        if(!name || !contentKey || !count)
+            return false;
+        entry.file = *name;
+        entry.contentKey = *contentKey;
+        for(auto j = 0U; j < *count; ++j) {
+            auto symbolName = reader.string();
+            auto text = reader.string();
+            auto anchor = reader.string();
+            const auto line = reader.number();
+            if(!symbolName || !text || !anchor || !line)
+                return false;
+            entry.symbols.push_back({std::move(*symbolName), std::move(*text), std::move(*anchor), static_cast<int>(*line)});
+        }
+        m_positions[entry.file] = m_entries.size();
+        m_entries.push_back(std::move(entry));
+    }
+    return reader.atEnd();
+}
+
+bool SymbolIndex::isCurrent(const std::string& file, const std::string& contentKey) const {
+    const auto it = m_positions.find(file);
+    return it != m_positions.end() && m_entries[it->second].contentKey == contentKey;
+}
+
+void SymbolIndex::set(const std::string& file, const std::string& contentKey, std::vector<Symbol> symbols) {
+    if(isCurrent(file, contentKey))
+        return;
+    const auto it = m_positions.find(file);
+    if(it == m_positions.end()) {
+        m_positions[file] = m_entries.size();
+        m_entries.push_back({file, contentKey, std::move(symbols)});
+    } else {
+        m_entries[it->second] = {file, contentKey, std::move(symbols)};
+    }
+    ++m_revision;
+}
+
+void SymbolIndex::retain(const std::vector<std::string>& files) {
+    // the order before, a reordered input changes the index as well
+    std::vector<std::string> previous;
+    std::transform(m_entries.begin(), m_entries.end(), std::back_inserter(previous), [](const auto& entry) {return entry.file;});
+    std::vector<Entry> entries;
+    for(const auto& file : files) {
+        const auto it = m_positions.find(file);
+        if(it != m_positions.end())
+            entries.push_back(std::move(m_entries[it->second]));
+    }
+    const auto changed = !std::equal(previous.begin(), previous.end(), entries.begin(), entries.end(),
+                                     [](const auto& file, const auto& entry) {return file == entry.file;});
+    m_entries = std::move(entries);
+    m_positions.clear();
+    for(auto i = 0U; i < m_entries.size(); ++i)
+        m_positions[m_entries[i].file] = i;
+    if(changed)
+        ++m_revision;
+}
+
+bool SymbolIndex::save() {
+    if(m_revision == m_saved)
+        return true;
+    Writer writer;
+    writer.number(m_entries.size());
+    for(const auto& entry : m_entries) {
+        writer.string(entry.file).string(entry.contentKey).number(entry.symbols.size());
+        for(const auto& symbol : entry.symbols)
+            writer.string(symbol.name).string(symbol.text).string(symbol.anchor).number(static_cast<std::size_t>(std::max(symbol.line, 0)));
+    }
+    // written aside and renamed, a failed run does not leave a broken index nor meets the one of another run
+    if(!atomicReplace(m_fileName, std::string(IndexFormat) + '\n' + writer.data())) {
+        std::cerr << "Cannot write index:" << m_fileName << std::endl;
+        return false;
+    }
+    m_saved = m_revision;
+    return true;
+}
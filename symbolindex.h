@@ -0,0 +1,48 @@
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/*
+ * Table of contents links of every source file of a project, kept in a binary file
+ * between the runs. A file is indexed again only when its content key has changed.
+ */
+class SymbolIndex {
+public:
+    struct Symbol {
+        std::string name;   // token: scope, class, namespace, function..., or scopeend
+        std::string text;   // empty for the scope start and end markers
+        std::string anchor;
+        int line;
+    };
+    struct Entry {
+        std::string file;
+        std::string contentKey;
+        std::vector<Symbol> symbols;
+    };
+public:
+    /* Loads the index if it exists and is valid, otherwise the index is empty */
+    explicit SymbolIndex(const std::string& fileName);
+    /* True if the symbols of the file were indexed from the content */
+    bool isCurrent(const std::string& file, const std::string& contentKey) const;
+    void set(const std::string& file, const std::string& contentKey, std::vector<Symbol> symbols);
+    /* Keeps only the given files, in the given order */
+    void retain(const std::vector<std::string>& files);
+    /* Files in the project order */
+    const std::vector<Entry>& entries() const {return m_entries;}
+    /* Changes since loaded, the file is written only if there are any */
+    unsigned revision() const {return m_revision;}
+    bool save();
+private:
+    bool load();
+private:
+    const std::string m_fileName;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, std::size_t> m_positions; // file name to its entry
+    unsigned m_revision = 0;
+    unsigned m_saved = 0;
+};
+
+#endif // SYMBOLINDEX_H
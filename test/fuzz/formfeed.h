@@ -0,0 +1,60 @@
+/**
+ * @toc
+@ignore
+ * Two namespaces with a class of the same name.
+ */
+
+/**
+ * @namespace Plane
+ */
+namespace Plane {
+
+/**
+ * @class Point
+ * A point of the plane.
+ */
+clas
+public:
+    /**
+     * @function length
+     */
+    double length() const;
+};
+/**
+ * @scopeend
+ */
+
+}
+/**
+ * @scopeend
+ */
+
+/**
+ * @namespace Space
+ */
+namespace Space {
+
+/**
+ * @class Point
+ * A point of the space.
+class Point {
+public:
+    /**
+     * @function length
+     */
+   double length() const;
+};
+/**
+ * @scopeend
+ */
+
+}
+/**
+ * @scopeend
+ */
+
+/**
+ * @function distance
+ * Outside of the namespaces.
+ *
+double distance(const Plane::Point& a, const Plane::Point& b);
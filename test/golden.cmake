@@ -0,0 +1,65 @@
+# Runs mdmaker and compares its output with the stored golden files.
+#
+# cmake -DMDMAKER=path -DARGS="arg|arg" -DOUTPUT=path -DEXPECTED=path <-DMASK=regex> <-DERRORS=regex>
+#       <-DINPUT=path> <-DSTDOUT=path> -P golden.cmake
+#
+# OUTPUT is the output of mdmaker (-o or --split), the golden EXPECTED is a file or a directory whose
+# every file is compared with the file of the same name in OUTPUT. The text that matches MASK, e.g. a
+# generation date, is not compared. The stderr of mdmaker has to match ERRORS if given. INPUT is read
+# as the stdin of mdmaker, and its stdout is written to STDOUT with the lines sorted, as the responses
+# of --serve are in the order the jobs complete.
+
+file(REMOVE_RECURSE ${OUTPUT})
+get_filename_component(parent ${OUTPUT} DIRECTORY)
+file(MAKE_DIRECTORY ${parent})
+if(IS_DIRECTORY ${EXPECTED})
+    file(MAKE_DIRECTORY ${OUTPUT})
+endif()
+string(REPLACE "|" ";" ARGS "${ARGS}")
+if(INPUT)
+    set(input INPUT_FILE ${INPUT})
+endif()
+execute_process(COMMAND ${MDMAKER} ${ARGS} ${input} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "mdmaker ${ARGS} failed (${result}): ${errors}")
+endif()
+if(ERRORS AND NOT errors MATCHES "${ERRORS}")
+    message(FATAL_ERROR "mdmaker ${ARGS} errors do not match ${ERRORS}: ${errors}")
+endif()
+if(STDOUT)
+    string(REGEX REPLACE "\n$" "" output "${output}")
+    string(REPLACE "\n" ";" lines "${output}")
+    list(SORT lines)
+    string(REPLACE ";" "\n" output "${lines}")
+    file(WRITE ${STDOUT} "${output}\n")
+endif()
+
+if(IS_DIRECTORY ${EXPECTED})
+    file(GLOB_RECURSE files RELATIVE ${EXPECTED} ${EXPECTED}/*)
+else()
+    get_filename_component(EXPECTED_DIR ${EXPECTED} DIRECTORY)
+    get_filename_component(file ${EXPECTED} NAME)
+    set(files ${file})
+    set(EXPECTED ${EXPECTED_DIR})
+    get_filename_component(OUTPUT_NAME ${OUTPUT} NAME)
+    get_filename_component(OUTPUT ${OUTPUT} DIRECTORY)
+endif()
+
+foreach(file ${files})
+    set(actual ${OUTPUT}/${file})
+    if(OUTPUT_NAME)
+        set(actual ${OUTPUT}/${OUTPUT_NAME})
+    endif()
+    if(NOT EXISTS ${actual})
+        message(FATAL_ERROR "${actual} not written")
+    endif()
+    file(READ ${EXPECTED}/${file} expectedText)
+    file(READ ${actual} actualText)
+    if(MASK)
+        string(REGEX REPLACE "${MASK}" "" expectedText "${expectedText}")
+        string(REGEX REPLACE "${MASK}" "" actualText "${actualText}")
+    endif()
+    if(NOT expectedText STREQUAL actualText)
+        message(FATAL_ERROR "${actual} differs from ${EXPECTED}/${file}")
+    endif()
+endforeach()
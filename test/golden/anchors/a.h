@@ -0,0 +1,18 @@
+/**
+ * @toc
+ */
+
+/**
+ * @class Point
+ * A point of a.h.
+ */
+class Point {
+public:
+    /**
+     * @function length
+     */
+    double length() const;
+};
+/**
+ * @scopeend
+ */
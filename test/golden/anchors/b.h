@@ -0,0 +1,28 @@
+/**
+ * @toc
+ */
+
+/**
+ * @class Point
+ * A point of b.h, its anchors are numbered past the ones of a.h.
+ */
+class Point {
+public:
+    /**
+     * @function length
+     */
+    double length() const;
+};
+/**
+ * @scopeend
+ */
+
+/**
+ * @class Point 1
+ * Has the anchor that the second Point of the output gets from its number.
+ */
+class Point1 {
+};
+/**
+ * @scopeend
+ */
@@ -0,0 +1,11 @@
+/**
+ * @toc
+ * A source whose error line tells its name, the same in a/ and b/.
+ */
+
+/**
+ * @class Unbalanced
+ * The scope is not ended.
+ */
+class Unbalanced {
+};
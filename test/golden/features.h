@@ -0,0 +1,76 @@
+#ifndef FEATURES_H
+#define FEATURES_H
+
+/**
+ * @toc
+ * The annotations of MarkdownMaker, escaped <html> & "quotes" and the codes @{x41}@{x2a}.
+ */
+
+/**
+ * @namespace Shapes
+ * Geometry for the examples.
+ */
+namespace Shapes {
+
+/**
+ * @class Shape
+ * Base of all shapes.
+ * @templateparam T type of the coordinates
+ */
+template <typename T>
+class Shape {
+public:
+    /**
+     * @function area
+     * Area of the shape
+     * @return area in square units
+     */
+    virtual T area() const = 0;
+    /**
+     * @function moveTo
+     * Moves the shape, e.g.
+     * ```
+     * shape.moveTo(1, 2); // "moved"\n
+     * ```
+     * @param x to
+     * @param y to
+     */
+    MDMAKER_EXPORT void moveTo(T x,
+        T y);
+};
+/**
+ * @scopeend
+ */
+
+/**
+ * @typedef Shapes::Area
+ * @brief Area of a shape
+ * ~~~
+ * using Area = double;
+ * ~~~
+ */
+using Area = double;
+
+/**
+ * @class Circle
+ * @style class ##### Shape: %1
+ * @raw <b>Raw</b> \n text
+ * @eol
+ * @ignore this line
+ * @note styled with the default style
+ */
+class Circle : public Shape<double> {
+    /**
+     * @function radius
+     */
+    double radius() const;
+};
+/**
+ * @scopeend
+ */
+}
+/**
+ * @scopeend
+ */
+
+#endif // FEATURES_H
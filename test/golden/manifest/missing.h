@@ -0,0 +1,8 @@
+/**
+ * @function missing
+ * The declaration is not found before the next comment.
+ */
+
+/**
+ * @class Next
+ */
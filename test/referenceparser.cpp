@@ -0,0 +1,428 @@
+#include "referenceparser.h"
+#include "markdownmaker.h"
+#include "declarationmatcher.h"
+#include <regex>
+#include <iostream>
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <optional>
+#include <stack>
+#include <unordered_map>
+
+namespace {
+
+bool isScope(const std::string& command) {
+    return command == "scope" || command == "class" || command == "namespace" || command == "struct";
+}
+
+std::string htmlEscaped(const std::string& str) {
+    std::string out;
+    for(auto b : str) {
+        switch (b) {
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '&': out += "&amp;"; break;
+        case '"': out += "&quot;"; break;
+        case '\'': out+=  "&#39;"; break;
+        default: out += b;
+        }
+    }
+    return out;
+}
+
+std::string dateNow() {
+     const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+     return std::ctime(&now);
+}
+
+std::string replace(const std::string& where, const std::string& what, const std::string& how) {
+    std::regex re(what);
+    return std::regex_replace(where, re, how);
+}
+
+void replace(std::string& where, const std::string& what, const std::string& how) {
+   std::string out = replace(static_cast<const std::string&>(where), what, how);
+   where = out;
+}
+
+std::string replace(const std::string& where, const char what, const std::string& how) {
+    std::string::size_type pos = 0;
+    std::string replaced;
+    for(;;) {
+        const auto index = where.find_first_of(what, pos);
+        if(index == std::string::npos)
+            break;
+        replaced += where.substr(pos, index - pos);
+        replaced += how;
+        pos = index + 1;
+    }
+    replaced += where.substr(pos);
+    return replaced;
+}
+
+void replace(std::string& where, const char what, const std::string& how) {
+   std::string out = replace(static_cast<const std::string&>(where), what, how);
+   where = out;
+}
+
+std::string trim(const std::string &cs) {
+    auto s  = cs;
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](auto ch) {
+        return !std::isspace(ch);}));
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](auto ch) {
+        return !std::isspace(ch);
+    }).base(), s.end());
+    return s;
+}
+
+std::string makeLink(const std::string& uri)  {
+    return replace(trim(replace(replace(toLower(trim(uri)), R"((&lt;)|(&gt;)|(&amp;)|(&quot;))", ""), R"([^\w ]+)", "")), R"(\s+)", "-");
+}
+
+/* Code point as UTF-8 */
+std::string utf8(unsigned long code) {
+    if(code < 0x80)
+        return std::string(1, static_cast<char>(code));
+    if(code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+        code = 0xFFFD;
+    std::string out;
+    const auto byte = [&out](unsigned long b) {out += static_cast<char>(b);};
+    if(code < 0x800) {
+        byte(0xC0 | (code >> 6));
+    } else if(code < 0x10000) {
+        byte(0xE0 | (code >> 12));
+        byte(0x80 | ((code >> 6) & 0x3F));
+    } else {
+        byte(0xF0 | (code >> 18));
+        byte(0x80 | ((code >> 12) & 0x3F));
+        byte(0x80 | ((code >> 6) & 0x3F));
+    }
+    byte(0x80 | (code & 0x3F));
+    return out;
+}
+
+std::string decode(const std::string& line) {
+    std::string decoded;
+    const std::regex code(R"(@\{((?:x[0-9a-f]+)|(?:\d+))\})", std::regex::icase);
+    auto it = std::sregex_iterator(line.begin(), line.end(), code);
+    std::string::size_type pos = 0;
+    for(;it != std::sregex_iterator(); ++it) {
+        const auto match = *it;
+        const auto start = static_cast<std::string::size_type>(match.position());
+        decoded += line.substr(pos, start - pos);
+        const auto value = match[1].str();
+        try {
+            decoded += utf8(static_cast<unsigned long>(value.at(0) == 'x' ? std::stoi(value.substr(1), nullptr, 16) : std::stoi(value.substr(1))));
+        } catch(const std::invalid_argument&) {
+            return "INVALID";
+        } catch(const std::out_of_range&) {
+            decoded += utf8(0x110000);
+        }
+        pos = static_cast<std::string::size_type>(match.position() + match.length());
+    }
+    decoded += line.substr(pos);
+    return decoded;
+}
+
+std::string removeAsterisk(const std::string& line) {
+    const std::regex ast(R"(\s*\*\s*(.*))");
+    std::smatch match;
+    return std::regex_search(line, match, ast) ?
+                match[1].str() : line;
+}
+
+/*
+ * The output of a line as MarkdownMaker 1.0 wrote it
+ */
+std::string outputLine(const std::string& line) {
+    auto out = replace(line, R"(\\n)", "");
+    replace(out, R"(\\(.))", "$1");
+    return out + "\n";
+}
+
+class ReferenceParser {
+    enum class State {Out, In, Example1, Example2};
+    enum class Cmd {Add, Toc, GlobalToc, Header};
+    struct Link {
+        std::string name;
+        std::string uri;
+        int line;
+        std::string anchor;
+    };
+    struct Content {
+        Cmd cmd;
+        std::string name;
+        std::string value;
+        std::string  uri;
+    };
+public:
+    ReferenceParser(const std::string& sourceName);
+    bool parseLine(const std::string& line);
+    void complete();
+    const std::string& markdown() const {return m_markdown;}
+private:
+    bool fail(const std::string& message, int line);
+    void appendLine(const std::string& str) {m_markdown += outputLine(str);}
+    std::string style(const std::string& name) const;
+    std::string join() const;
+    std::string anchor(const std::string& text);
+    std::vector<Content>& content() {return m_content[m_scopeStack.top()];}
+private:
+    const std::string m_sourceName;
+    std::map<std::string, std::string> m_styles;
+    State m_state = State::Out;
+    std::vector<std::vector<Content>> m_content;
+    std::vector<Link> m_links;
+    std::stack<std::size_t> m_scopeStack;
+    std::vector<std::string> m_scopes;
+    std::optional<std::pair<std::size_t, std::size_t>> m_briefName;
+    DeclarationMatcher m_declaration;
+    std::unordered_map<std::string, int> m_anchors;
+    int m_line = 0;
+    std::string m_markdown;
+};
+
+ReferenceParser::ReferenceParser(const std::string& name) :
+    m_sourceName(name) {
+    for(const auto& [styleName, style] : defaultStyles())
+        m_styles.emplace(styleName, style.source());
+    m_scopeStack.push(0);
+    m_scopes.push_back("_root");
+    m_content.emplace_back();
+}
+
+std::string ReferenceParser::style(const std::string& name) const {
+    const auto it = m_styles.find(name);
+    return it == m_styles.end() ? std::string(defaultStyle().source()) : it->second;
+}
+
+std::string ReferenceParser::join() const {
+    auto copy = m_scopeStack;
+    std::string s;
+    while(!copy.empty()) {
+        const auto v = m_scopes[copy.top()];
+        if(v == "_root")
+            break;
+        if(!s.empty())
+            s.insert(0, v + "::");
+        else
+            s = v;
+          copy.pop();
+    }
+    return s;
+}
+
+std::string ReferenceParser::anchor(const std::string& text) {
+    const auto link = makeLink(text);
+    auto numbered = link;
+    const auto it = m_anchors.find(link);
+    if(it != m_anchors.end()) {
+        do {
+            numbered = link + "-" + std::to_string(++it->second);
+        } while(m_anchors.count(numbered));
+    }
+    m_anchors.emplace(numbered, 0);
+    return numbered;
+}
+
+bool ReferenceParser::fail(const std::string& s, int line) {
+    auto err = decode(s + ", " + replace(m_sourceName, '\\', "/") + " at " +
+                      std::to_string(m_line) + " (ref:(" +
+                      std::to_string(line) + ")");
+
+    replace(err, '\n', "");
+    replace(err, '\r', "");
+    replace(err, "\\n", "");
+    replace(err, "\\r", "");
+    replace(err, '"', "'");
+    replace(err, '\\', "");
+    std::cerr << err;
+    appendLine(err + "<br/>");
+    return true;
+}
+
+#define S_ASSERT(x, s) if(!(x) && fail(s, __LINE__)) return false;
+
+bool ReferenceParser::parseLine(const std::string& line) {
+    ++m_line;
+    if(m_state != State::Out) {
+        const std::regex example1(R"(```)");
+        const std::regex example2(R"(\~\~\~)");
+        const std::regex blockCommentEnd(R"(\*/)");
+        const std::regex meta(R"(\s*\*\s*@([a-z]+)\s*(.*)(\\n))");
+        std::smatch match;
+        if(std::regex_search(line, match, blockCommentEnd)) {
+            m_state = State::Out;
+        } else {
+            std::smatch bm;
+            if(std::regex_search(line, bm, meta)) {
+                const auto command = bm[1].str();
+                const auto value = decode(bm[2].str());
+
+                if(isScope(command)) {
+                    m_scopes.push_back(value);
+                    m_scopeStack.push(m_scopes.size() - 1);
+                    m_content.emplace_back();
+                    content().push_back({Cmd::Add, "", "\\n", ""});
+                    content().push_back({Cmd::Add, "", "---\\n", ""});
+                }
+
+                if(command == "class" || command == "namespace" || command == "typedef") {
+                    const auto uri = anchor(value);
+                    m_links.push_back({command, value, m_line, uri});
+                    content().push_back({Cmd::Header, command, join(), uri});
+                }
+
+                else if(command == "toc") {
+                    content().push_back({Cmd::Toc, "", "", ""});
+                } else if(command == "globaltoc") {
+                    content().push_back({Cmd::GlobalToc, "", "", ""});
+                } else if(command == "date") {
+                    content().push_back({Cmd::Header, command, dateNow(), ""});
+                } else if(command == "scopeend") {
+                    content().push_back({Cmd::Add, "", "\\n", ""});
+                    content().push_back({Cmd::Add, "", "---\\n", ""});
+                    if(m_scopeStack.size() > 1)
+                        m_scopeStack.pop();
+                    m_links.push_back({"scopeend", "", m_line, ""});
+                } else if(command == "style") {
+                    auto sep = value.find_first_of(' ');
+                    if(sep > 0) {
+                        m_styles[value.substr(0, sep)] = value.substr(sep + 1);
+                    } else {
+                        std::cerr << "Invalid style" << value;
+                    }
+                } else if(command == "function") {
+                    S_ASSERT(!m_briefName, "Only one brief or function allowed:" + line);
+                    S_ASSERT(m_scopeStack.size() > 0, "No top");
+                    content().push_back({Cmd::Header, command, value, ""});
+                    m_briefName = std::make_optional<std::pair<std::size_t, std::size_t>>({m_scopeStack.top(), content().size() - 1});
+                    m_declaration.reset();
+                } else if(command == "raw") {
+                    content().push_back({Cmd::Add, "", value, ""});
+                } else if(command == "eol") {
+                    content().push_back({Cmd::Add, "", "\\n", ""});
+                } else if(command == "ignore") {
+                   //ignore
+                } else {
+                    content().push_back({Cmd::Header, command, value, ""});
+                }
+
+                if(isScope(command)) {
+                    m_links.push_back({command, "", m_line, ""});
+                }
+
+            } else if(m_state != State::Example2 && std::regex_search(line, match, example1)) {
+                if(m_state == State::In) {
+                    m_state = State::Example1;
+                } else {
+                    m_state = State::In;
+                }
+                content().push_back({Cmd::Add, "", "```\\n", ""});
+            } else if(m_state != State::Example1 && std::regex_search(line, match, example2)) {
+                if(m_state == State::In) {
+                    m_state = State::Example2;
+                } else {
+                    m_state = State::In;
+                }
+                content().push_back({Cmd::Add, "", "~~~\\n", ""});
+            } else if(m_state == State::In) {
+                const auto ref = decode(removeAsterisk(line));
+                content().push_back({Cmd::Add, "", htmlEscaped(ref), ""});
+            } else if(m_state == State::Example1 || m_state == State::Example2) {
+                auto ref = decode(removeAsterisk(line));
+                replace(ref, '\n', "");
+                replace(ref, '\\', "\\\\");
+                replace(ref, '"', "\\\"");
+                content().push_back({Cmd::Add, "", ref + "  \\n", ""});
+            }
+        }
+    } else {
+        if(m_briefName) {
+            Content& content = m_content[m_briefName->first][m_briefName->second];
+            const auto status = m_declaration.match(line.substr(0, line.size() - 2), content.value);
+            S_ASSERT(status != DeclarationMatcher::Status::TooLong, "Cannot understand as a function:" + line)
+            if(status == DeclarationMatcher::Status::Found) {
+                const auto value = htmlEscaped(replace(m_declaration.declaration(), R"(^\s*\w+(_EXPORT))", ""));
+                const auto link = anchor(value);
+                content = {Cmd::Header, content.name, value, link};
+                m_links.push_back({content.name, value, m_line, link});
+                m_briefName = std::nullopt;
+            }
+        }
+        const std::regex mdCommentStart(R"(/\*\*)");
+        std::smatch match;
+        if(std::regex_search(line, match, mdCommentStart)) {
+            m_state = State::In;
+            S_ASSERT(!m_briefName, "function not found \\\""
+                     + m_content[m_briefName->first][m_briefName->second].value + "\\\"")
+        }
+    }
+    return true;
+}
+
+void ReferenceParser::complete() {
+    for(const auto& scope : m_content) {
+        for(const auto& line : scope) {
+            switch(line.cmd) {
+            case Cmd::Add:
+                appendLine(line.value);
+                break;
+            case Cmd::Toc: {
+                int scopeDepth = 0;
+                for(const auto& link : m_links) {
+                    if(link.name == "scopeend") {
+                        --scopeDepth;
+                        continue;
+                    }
+                    else if(link.uri == "") {
+                        ++scopeDepth;
+                        continue;
+                    }
+                    if(scopeDepth < 0) {
+                        fail("Negative scope", link.line);
+                        break;
+                    }
+                    const std::string pre = scopeDepth > 0 ? std::string(2 * static_cast<std::size_t>(scopeDepth), ' ') + '*' : "*";
+                    const std::string name = isScope(link.name) ? " " + link.name + " " : " ";
+                    appendLine(pre + " [" + name + link.uri + " ](#" +  link.anchor + ")" + "\\n");
+                }
+                if(scopeDepth != 0) {
+                    fail("Unbalanced scope (0 != " + std::to_string(scopeDepth) + ")", -1);
+                    break;
+                }
+                }
+                break;
+            case Cmd::GlobalToc:
+                fail("globaltoc requires an index (--index)", -1);
+                break;
+            case Cmd::Header: {
+                if(!line.uri.empty())
+                    appendLine("<a id=\"" + line.uri + "\"></a>");
+                appendLine(replace(style(line.name) + " \\n", "%1", line.value));
+                break;
+            }
+            }
+        }
+    }
+}
+}
+
+std::string referenceMarkdown(const std::string& source, const std::string& sourceName) {
+    ReferenceParser parser(sourceName);
+    std::string::size_type pos = 0;
+    while(pos < source.size()) {
+        const auto end = source.find('\n', pos);
+        const auto line = source.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        if(!parser.parseLine(line + "\\n")) {
+            std::cerr << "Parse error:" << line << std::endl;
+            break;
+        }
+        if(end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+    parser.complete();
+    return parser.markdown();
+}
@@ -0,0 +1,18 @@
+#ifndef REFERENCEPARSER_H
+#define REFERENCEPARSER_H
+
+#include <string>
+
+/*
+ * The markdown of a source as rendered by the regex based SourceParser of MarkdownMaker 1.0,
+ * the reference of the optimised parser in mdmaker_fuzz. The lines are joined with newlines.
+ *
+ * The parser is kept as it was, apart from the changes made to the output on purpose since:
+ * * @{...} codes above 0x7F are UTF-8, values that are not code points are U+FFFD.
+ * * Scopes of the same name are separate and @scopeend does not close the root.
+ * * The anchors of headers are slugs of their text, a repeated anchor is numbered as GitHub does.
+ * * The declaration of a @function is found with DeclarationMatcher, the regex backtracked on long lines.
+ */
+std::string referenceMarkdown(const std::string& source, const std::string& sourceName);
+
+#endif // REFERENCEPARSER_H
@@ -0,0 +1,70 @@
+#ifndef TEXTARENA_H
+#define TEXTARENA_H
+
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <cstring>
+#include <algorithm>
+
+/*
+ * Append-only storage of strings. The returned views stay valid as long as
+ * the arena, text is copied to large blocks instead of allocating each string.
+ */
+class TextArena {
+public:
+    TextArena() = default;
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+    TextArena(TextArena&&) = default;
+    TextArena& operator=(TextArena&&) = default;
+    /* Copy of the text */
+    std::string_view add(std::string_view text) {
+        if(text.empty())
+            return {};
+        if(text.size() > m_left)
+            reserve(text.size());
+        const auto data = m_free;
+        std::memcpy(data, text.data(), text.size());
+        m_free += text.size();
+        m_left -= text.size();
+        return {data, text.size()};
+    }
+    /* Shared copy of the text, for the often repeated strings */
+    std::string_view intern(std::string_view text) {
+        const auto it = m_interned.find(text);
+        if(it != m_interned.end())
+            return *it;
+        return *m_interned.insert(add(text)).first;
+    }
+    /* Bytes allocated */
+    std::size_t size() const {return m_size;}
+    /* Releases all the text, only the first block is kept for reuse */
+    void clear() {
+        m_blocks.resize(std::min<std::size_t>(m_blocks.size(), 1));
+        m_interned.clear();
+        m_size = m_blocks.empty() ? 0 : MinBlockSize;
+        m_free = m_blocks.empty() ? nullptr : m_blocks.front().get();
+        m_left = m_size;
+    }
+private:
+    void reserve(std::size_t size) {
+        // blocks grow, small sources need only a little
+        const auto blockSize = std::max(size, (m_blocks.size() < 6 ? MinBlockSize << m_blocks.size() : MaxBlockSize));
+        m_blocks.push_back(std::unique_ptr<char[]>(new char[blockSize]));
+        m_free = m_blocks.back().get();
+        m_left = blockSize;
+        m_size += blockSize;
+    }
+private:
+    static constexpr std::size_t MinBlockSize = 1024;
+    static constexpr std::size_t MaxBlockSize = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    char* m_free = nullptr;
+    std::size_t m_left = 0;
+    std::size_t m_size = 0;
+    std::unordered_set<std::string_view> m_interned;
+};
+
+#endif // TEXTARENA_H
@@ -0,0 +1,182 @@
+#include "textsearch.h"
+#include <cstring>
+#include <bitset>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTSEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(TEXTSEARCH_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define TEXTSEARCH_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+static unsigned bitCount(unsigned mask) {
+    return static_cast<unsigned>(std::bitset<32>(mask).count());
+}
+
+/*
+ * Candidates are positions where both the first and the last character of the needle match,
+ * mask bits are tested in order and the middle part compared.
+ */
+static bool testCandidates(unsigned mask, const char* at, std::string_view needle, std::size_t& found) {
+    while(mask) {
+        const auto bit = lowestBit(mask);
+        if(std::memcmp(at + bit + 1, needle.data() + 1, needle.size() - 2) == 0) {
+            found = bit;
+            return true;
+        }
+        mask &= mask - 1;
+    }
+    return false;
+}
+
+static std::size_t findScalar(std::string_view text, std::string_view needle, std::size_t pos) {
+    return text.find(needle, pos);
+}
+
+static std::size_t countScalar(const char* data, std::size_t size, char c) {
+    std::size_t count = 0;
+    for(auto i = 0U; i < size; ++i)
+        count += data[i] == c;
+    return count;
+}
+
+static std::size_t findAnyScalar(std::string_view text, std::string_view chars, std::size_t pos) {
+    return text.find_first_of(chars, pos);
+}
+
+#ifdef TEXTSEARCH_SSE2
+
+static std::size_t findAnySse2(std::string_view text, std::string_view chars, std::size_t pos) {
+    __m128i values[8];
+    for(auto c = 0U; c < chars.size(); ++c)
+        values[c] = _mm_set1_epi8(chars[c]);
+    auto i = pos;
+    for(; i + 16 <= text.size(); i += 16) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        auto any = _mm_cmpeq_epi8(a, values[0]);
+        for(auto c = 1U; c < chars.size(); ++c)
+            any = _mm_or_si128(any, _mm_cmpeq_epi8(a, values[c]));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(any));
+        if(mask)
+            return i + lowestBit(mask);
+    }
+    return findAnyScalar(text, chars, i);
+}
+
+static std::size_t findSse2(std::string_view text, std::string_view needle, std::size_t pos) {
+    const auto first = _mm_set1_epi8(needle.front());
+    const auto last = _mm_set1_epi8(needle.back());
+    const auto tail = needle.size() - 1;
+    auto i = pos;
+    for(; i + tail + 16 <= text.size(); i += 16) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i + tail));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        std::size_t found;
+        if(testCandidates(mask, text.data() + i, needle, found))
+            return i + found;
+    }
+    return findScalar(text, needle, i);
+}
+
+static std::size_t countSse2(const char* data, std::size_t size, char c) {
+    const auto value = _mm_set1_epi8(c);
+    std::size_t count = 0;
+    auto i = 0U;
+    for(; i + 16 <= size; i += 16) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        count += bitCount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, value))));
+    }
+    return count + countScalar(data + i, size - i, c);
+}
+
+#endif
+
+#ifdef TEXTSEARCH_AVX2
+
+__attribute__((target("avx2")))
+static std::size_t findAvx2(std::string_view text, std::string_view needle, std::size_t pos) {
+    const auto first = _mm256_set1_epi8(needle.front());
+    const auto last = _mm256_set1_epi8(needle.back());
+    const auto tail = needle.size() - 1;
+    auto i = pos;
+    for(; i + tail + 32 <= text.size(); i += 32) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i + tail));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+        std::size_t found;
+        if(testCandidates(mask, text.data() + i, needle, found))
+            return i + found;
+    }
+    return findSse2(text, needle, i);
+}
+
+__attribute__((target("avx2")))
+static std::size_t countAvx2(const char* data, std::size_t size, char c) {
+    const auto value = _mm256_set1_epi8(c);
+    std::size_t count = 0;
+    auto i = 0U;
+    for(; i + 32 <= size; i += 32) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        count += bitCount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, value))));
+    }
+    return count + countSse2(data + i, size - i, c);
+}
+
+static bool hasAvx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+#endif
+
+std::size_t findText(std::string_view text, std::string_view needle, std::size_t pos) {
+    if(needle.size() < 2 || pos >= text.size())
+        return findScalar(text, needle, pos);
+#if defined(TEXTSEARCH_AVX2)
+    if(hasAvx2())
+        return findAvx2(text, needle, pos);
+#endif
+#if defined(TEXTSEARCH_SSE2)
+    return findSse2(text, needle, pos);
+#else
+    return findScalar(text, needle, pos);
+#endif
+}
+
+std::size_t findAnyOf(std::string_view text, std::string_view chars, std::size_t pos) {
+#if defined(TEXTSEARCH_SSE2)
+    if(!chars.empty() && chars.size() <= 8 && pos < text.size())
+        return findAnySse2(text, chars, pos);
+#endif
+    return findAnyScalar(text, chars, pos);
+}
+
+std::size_t countChar(std::string_view text, char c) {
+#if defined(TEXTSEARCH_AVX2)
+    if(hasAvx2())
+        return countAvx2(text.data(), text.size(), c);
+#endif
+#if defined(TEXTSEARCH_SSE2)
+    return countSse2(text.data(), text.size(), c);
+#else
+    return countScalar(text.data(), text.size(), c);
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <string_view>
+
+/*
+ * Vectorized (AVX2 / SSE2 / scalar) search primitives used to skip the source
+ * code between documentation blocks and plain runs of documentation text.
+ */
+
+/* Position of the first occurrence of needle at or after pos, or npos */
+std::size_t findText(std::string_view text, std::string_view needle, std::size_t pos = 0);
+
+/* Position of the first character at or after pos that is one of chars (at most 8), or npos */
+std::size_t findAnyOf(std::string_view text, std::string_view chars, std::size_t pos = 0);
+
+/* Number of occurrences of c in the text */
+std::size_t countChar(std::string_view text, char c);
+
+#endif // TEXTSEARCH_H
@@ -0,0 +1,87 @@
+#include "workpool.h"
+#include <algorithm>
+#include <thread>
+
+namespace {
+// the pool and the queue of the current worker
+thread_local const WorkPool* currentPool = nullptr;
+thread_local std::size_t currentQueue = 0;
+}
+
+WorkPool::WorkPool(unsigned jobs) {
+    for(auto i = 0U; i < std::max(1U, jobs); ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+}
+
+WorkPool::~WorkPool() {
+}
+
+void WorkPool::submit(Task task) {
+    const auto index = currentPool == this ? currentQueue : m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    {
+        // counted before the task can be taken, so a worker that completes it cannot see
+        // the pool done while the submitting task is still running
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        ++m_pending;
+        ++m_queued;
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    // the lock orders the count before the wait of an idle worker
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake.notify_one();
+}
+
+bool WorkPool::take(std::size_t index, Task& task) {
+    for(auto i = 0U; i < m_queues.size(); ++i) {
+        auto& queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty())
+            continue;
+        if(i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --m_queued;
+        return true;
+    }
+    return false;
+}
+
+void WorkPool::work(std::size_t index) {
+    // a task may run a pool of its own, the worker goes back to the outer pool after it
+    const auto outerPool = currentPool;
+    const auto outerQueue = currentQueue;
+    currentPool = this;
+    currentQueue = index;
+    Task task;
+    for(;;) {
+        if(take(index, task)) {
+            task();
+            task = nullptr;
+            if(--m_pending == 0) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this]() {return m_pending == 0 || m_queued > 0;});
+        if(m_pending == 0)
+            break;
+    }
+    currentPool = outerPool;
+    currentQueue = outerQueue;
+}
+
+void WorkPool::run() {
+    if(m_pending == 0)
+        return;
+    std::vector<std::thread> workers;
+    for(auto i = 1U; i < m_queues.size(); ++i)
+        workers.emplace_back([this, i]() {work(i);});
+    work(0);
+    std::for_each(workers.begin(), workers.end(), [](auto& t){t.join();});
+}
@@ -0,0 +1,46 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Work-stealing pool of threads. Each worker takes the tasks of its own queue,
+ * the latest first, and when it runs out takes the earliest task of another queue.
+ * A task may submit more tasks (e.g. the parts of a large file), they go to the
+ * queue of its worker, so a worker parsing a large file shares it with the idle ones.
+ */
+class WorkPool {
+public:
+    using Task = std::function<void()>;
+    /* Pool of at most jobs threads */
+    explicit WorkPool(unsigned jobs);
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+    /* Adds a task, from within a task to the queue of its worker */
+    void submit(Task task);
+    /* Runs the submitted tasks and the tasks they submit, returns when they are all done */
+    void run();
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    void work(std::size_t index);
+    bool take(std::size_t index, Task& task);
+private:
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<std::size_t> m_next{0};     // queue of a task submitted outside of the workers
+    std::atomic<std::size_t> m_queued{0};   // tasks in the queues
+    std::atomic<std::size_t> m_pending{0};  // tasks not completed
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+};
+
+#endif // WORKPOOL_H